@@ -0,0 +1,129 @@
+/* Contention benchmark of the lock-free MPMC queue against a Queue
+ * behind a mutex, with 1 to N producers and as many consumers
+ * Usage: bench_mpmc [max threads] [number of elements] */
+#include "../interpreter_mpmc.h"
+#include "../interpreter_queue.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+typedef struct Bench {
+  MpmcQueue *mpmc;
+  Queue *queue;
+  pthread_mutex_t lock;
+  long per_producer;
+  long total;
+  atomic_long removed;
+} Bench;
+
+static double Now() {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *MpmcProducer(void *arg) {
+  Bench *bench = arg;
+
+  for (long i = 0; i < bench->per_producer; i++) {
+    MpmcQueueInsertTail(bench->mpmc, "steven");
+  }
+  return NULL;
+}
+
+static void *MpmcConsumer(void *arg) {
+  Bench *bench = arg;
+
+  while (atomic_load(&bench->removed) < bench->total) {
+    if (MpmcQueueRemoveHead(bench->mpmc, NULL)) {
+      atomic_fetch_add(&bench->removed, 1);
+    } else {
+      sched_yield(); /* Empty */
+    }
+  }
+  return NULL;
+}
+
+static void *LockedProducer(void *arg) {
+  Bench *bench = arg;
+
+  for (long i = 0; i < bench->per_producer; i++) {
+    pthread_mutex_lock(&bench->lock);
+    QueueInsertTail(bench->queue, "steven");
+    pthread_mutex_unlock(&bench->lock);
+  }
+  return NULL;
+}
+
+static void *LockedConsumer(void *arg) {
+  Bench *bench = arg;
+  bool is_removed = false;
+
+  while (atomic_load(&bench->removed) < bench->total) {
+    pthread_mutex_lock(&bench->lock);
+    is_removed = QueueRemoveHead(bench->queue);
+    pthread_mutex_unlock(&bench->lock);
+    if (is_removed) {
+      atomic_fetch_add(&bench->removed, 1);
+    } else {
+      sched_yield(); /* Empty */
+    }
+  }
+  return NULL;
+}
+
+/* Return seconds taken by thread_num producers and thread_num consumers
+ * to pass about num elements through the queue */
+static double Run(bool is_locked, int thread_num, long num) {
+  pthread_t threads[2 * thread_num];
+  Bench bench;
+  double start = 0;
+
+  bench.mpmc = MpmcQueueNew();
+  bench.queue = QueueNew();
+  pthread_mutex_init(&bench.lock, NULL);
+  bench.per_producer = num / thread_num;
+  bench.total = bench.per_producer * thread_num;
+  atomic_init(&bench.removed, 0);
+  start = Now();
+  for (int i = 0; i < thread_num; i++) {
+    pthread_create(&threads[i], NULL,
+                   is_locked ? LockedProducer : MpmcProducer, &bench);
+    pthread_create(&threads[thread_num + i], NULL,
+                   is_locked ? LockedConsumer : MpmcConsumer, &bench);
+  }
+  for (int i = 0; i < 2 * thread_num; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  start = Now() - start;
+  MpmcQueueFree(bench.mpmc);
+  QueueFree(bench.queue);
+  pthread_mutex_destroy(&bench.lock);
+  return start;
+}
+
+int main(int argc, char **argv) {
+  int max_thread_num = 8;
+  long num = 2000000;
+  double mpmc_time = 0;
+  double locked_time = 0;
+
+  if (argc > 1) {
+    max_thread_num = atoi(argv[1]);
+  }
+  if (argc > 2) {
+    num = atol(argv[2]);
+  }
+  printf("%ld elements\n", num);
+  printf("threads  lock-free Mops/s  mutex Mops/s\n");
+  for (int thread_num = 1; thread_num <= max_thread_num; thread_num *= 2) {
+    mpmc_time = Run(false, thread_num, num);
+    locked_time = Run(true, thread_num, num);
+    printf("%3dx%-3d  %16.2f  %12.2f\n", thread_num, thread_num,
+           num / mpmc_time / 1e6, num / locked_time / 1e6);
+  }
+  return 0;
+}
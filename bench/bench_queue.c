@@ -0,0 +1,116 @@
+/* Benchmark of the list and the chunked queue and their sort engines
+ * Usage: bench_queue [number of elements] */
+#include "../interpreter_queue.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static double Now() {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Generates a string whose length is between 5 and 10 */
+static void NextString(unsigned long *seed, char *str) {
+  size_t len = 0;
+
+  *seed = *seed * 6364136223846793005UL + 1442695040888963407UL;
+  len = 5 + (*seed >> 33) % 6;
+  for (size_t i = 0; i < len; i++) {
+    *seed = *seed * 6364136223846793005UL + 1442695040888963407UL;
+    str[i] = 'a' + (*seed >> 33) % 26;
+  }
+  str[len] = '\0';
+}
+
+/* Return sum of lengths of all strings, reading every byte */
+static size_t Scan(Queue *queue) {
+  QueueIter iter;
+  const char *value = NULL;
+  size_t sum = 0;
+
+  QueueIterInit(&iter, queue);
+  while ((value = QueueIterNext(&iter)) != NULL) {
+    sum += strlen(value);
+  }
+  return sum;
+}
+
+/* Return true if strings of queue are in ascending order */
+static bool IsSorted(Queue *queue) {
+  QueueIter iter;
+  const char *prev = NULL;
+  const char *value = NULL;
+
+  QueueIterInit(&iter, queue);
+  while ((value = QueueIterNext(&iter)) != NULL) {
+    if (prev && strcmp(prev, value) > 0) {
+      return false;
+    }
+    prev = value;
+  }
+  return true;
+}
+
+static void Run(const char *name, QueueKind kind, SortMode mode,
+                int thread_num, int num) {
+  Queue *queue = QueueNewKind(kind);
+  unsigned long seed = 1;
+  char str[16];
+  double start = 0;
+  double insert_time = 0;
+  double scan_time = 0;
+  double sort_time = 0;
+  double sorted_scan_time = 0;
+  double free_time = 0;
+  size_t sum = 0;
+
+  start = Now();
+  for (int i = 0; i < num; i++) {
+    NextString(&seed, str);
+    if (!QueueInsertTail(queue, str)) {
+      printf("insert failed\n");
+      exit(-1);
+    }
+  }
+  insert_time = Now() - start;
+  start = Now();
+  sum += Scan(queue);
+  scan_time = Now() - start;
+  start = Now();
+  QueueSortParallel(queue, mode, thread_num, NULL);
+  sort_time = Now() - start;
+  if (!IsSorted(queue)) {
+    printf("%s is not sorted\n", name);
+    exit(-1);
+  }
+  start = Now();
+  sum += Scan(queue);
+  sorted_scan_time = Now() - start;
+  start = Now();
+  QueueFree(queue);
+  free_time = Now() - start;
+  printf("%-14s insert %8.3fs  scan %8.3fs  sort %8.3fs  "
+         "scan(sorted) %8.3fs  free %8.3fs  (%zu)\n",
+         name, insert_time, scan_time, sort_time, sorted_scan_time, free_time,
+         sum);
+}
+
+int main(int argc, char **argv) {
+  int num = 1000000;
+
+  if (argc > 1) {
+    num = atoi(argv[1]);
+  }
+  printf("%d elements\n", num);
+  Run("list", QUEUE_LIST, SORT_MERGE, 1, num);
+  Run("list-radix", QUEUE_LIST, SORT_RADIX, 1, num);
+  Run("list-j8", QUEUE_LIST, SORT_MERGE, 8, num);
+  Run("chunked", QUEUE_CHUNKED, SORT_MERGE, 1, num);
+  Run("chunked-radix", QUEUE_CHUNKED, SORT_RADIX, 1, num);
+  Run("chunked-j8", QUEUE_CHUNKED, SORT_MERGE, 8, num);
+  return 0;
+}
@@ -0,0 +1,69 @@
+/* Benchmark of generating random strings by rand() one character at a
+ * time against the bulk xoshiro256** generator
+ * Usage: bench_random [number of strings] */
+#include "../interpreter_random.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define STR_MIN_LEN 5
+#define STR_MAX_LEN 10
+#define BATCH_NUM 65536
+
+static double Now() {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Generates num strings the way the console used to, with rand() */
+static size_t RandStrings(char *buf, int num) {
+  const char alphabets[] = "abcdefghijklmnopqrstuvwxyz";
+  size_t str_len = 0;
+  char *str = buf;
+
+  for (int i = 0; i < num; i++) {
+    str_len = STR_MIN_LEN + rand() % (STR_MAX_LEN - STR_MIN_LEN + 1);
+    for (size_t j = 0; j < str_len; j++) {
+      str[j] = alphabets[rand() % 26];
+    }
+    str[str_len] = '\0';
+    str += str_len + 1;
+  }
+  return str - buf;
+}
+
+int main(int argc, char **argv) {
+  char *buf = malloc(BATCH_NUM * (STR_MAX_LEN + 1));
+  int num = 10000000;
+  int count = 0;
+  size_t bytes = 0;
+  double start = 0;
+  Random random;
+
+  if (argc > 1) {
+    num = atoi(argv[1]);
+  }
+  if (buf == NULL) {
+    return -1;
+  }
+  printf("%d strings\n", num);
+  srand(1);
+  start = Now();
+  for (int left = num; left > 0; left -= count) {
+    count = left < BATCH_NUM ? left : BATCH_NUM;
+    bytes += RandStrings(buf, count);
+  }
+  printf("%-10s %8.3fs  (%zu bytes)\n", "rand", Now() - start, bytes);
+  RandomSeed(&random, 1);
+  bytes = 0;
+  start = Now();
+  for (int left = num; left > 0; left -= count) {
+    count = left < BATCH_NUM ? left : BATCH_NUM;
+    bytes += RandomStrings(&random, buf, count, STR_MIN_LEN, STR_MAX_LEN);
+  }
+  printf("%-10s %8.3fs  (%zu bytes)\n", "xoshiro", Now() - start, bytes);
+  free(buf);
+  return 0;
+}
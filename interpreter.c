@@ -14,22 +14,29 @@ void Usage(char *program_name) {
   printf("Usage: %s [options] [args]\n", program_name);
   printf("Options:\n");
   printf("        -h              #Usage\n");
-  printf("        -f INPUT_FILE   #Read commands from a file\n");
+  printf("        -f INPUT_FILE   #Read commands from a file, or stdin if "
+         "it's -, where lines between repeat N { and } run N times\n");
   printf("        -v              #Make messages visible\n");
   printf("        -l LOG_FILE     #Log messages\n");
+  printf("        -T              #Track latency of each command for the "
+         "latency command\n");
+  printf("        -j JOURNAL_FILE #Journal changes of the queue and replay them "
+         "at startup\n");
 }
 
 int main(int argc, char **argv) {
   char *input_file = NULL; /* Path of command file */
   char *log_file = NULL; 
+  char *journal_file = NULL; /* Path of journal file */
   size_t input_file_len = 0;
   size_t log_file_len = 20;
   bool is_visible = false; /* the messages are visible if it's true */
+  bool is_latency_tracked = false;
   char c = 'h';
   time_t seconds = 0;
   struct tm *today;
 
-  while ((c = getopt(argc, argv, "hf:vl")) != -1) {
+  while ((c = getopt(argc, argv, "hf:vlj:T")) != -1) {
     switch (c) {
     case 'h': 
       Usage(argv[0]);
@@ -64,6 +71,12 @@ int main(int argc, char **argv) {
       sprintf(log_file, "log%04d-%02d-%02d", today->tm_year + 1900,
               today->tm_mon + 1, today->tm_mday);
       break;
+    case 'j':
+      journal_file = optarg;
+      break;
+    case 'T':
+      is_latency_tracked = true;
+      break;
     default:
       printf("Unknown option %c\n", c);
       Usage(argv[0]);
@@ -78,8 +91,20 @@ int main(int argc, char **argv) {
     FreeHistory();
     return -1;
   }
+  if (is_latency_tracked && !ConsoleTrackLatency()) {
+    FreeString(1, input_file);
+    FreeString(1, log_file);
+    FreeHistory();
+    return -1;
+  }
   SetMsgVisible(is_visible);
   SetLogFile(log_file);
+  if (journal_file && !ConsoleOpenJournal(journal_file)) {
+    FreeString(1, input_file);
+    FreeString(1, log_file);
+    FreeHistory();
+    return -1;
+  }
   if (!RunConsole(input_file, log_file, is_visible)) {
     FreeString(1, input_file);
     FreeString(1, log_file);
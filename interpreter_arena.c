@@ -0,0 +1,227 @@
+#include "interpreter_arena.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Rounds size up to a multiple of ARENA_ALIGN */
+static size_t ArenaRoundUp(size_t size) {
+  if (size == 0) {
+    size = 1;
+  }
+  return (size + ARENA_ALIGN - 1) & ~((size_t)ARENA_ALIGN - 1);
+}
+
+void ArenaInit(Arena *arena) {
+  if (arena) {
+    memset(arena, 0, sizeof(Arena));
+    arena->next_chunk_size = ARENA_MIN_CHUNK_SIZE;
+  }
+}
+
+/* Adds a chunk which is able to hold at least size bytes
+ * On success, return true */
+static bool ArenaGrow(Arena *arena, size_t size) {
+  size_t chunk_size = arena->next_chunk_size;
+  ArenaChunk *chunk = NULL;
+
+  if (chunk_size < ARENA_MIN_CHUNK_SIZE) {
+    chunk_size = ARENA_MIN_CHUNK_SIZE;
+  }
+  while (chunk_size < size) {
+    chunk_size *= 2;
+  }
+  chunk = malloc(sizeof(ArenaChunk) + chunk_size);
+  if (chunk == NULL) {
+    return false;
+  }
+  chunk->size = chunk_size;
+  chunk->used = 0;
+  chunk->next = arena->chunks;
+  if (arena->chunks == NULL) {
+    arena->chunk_tail = chunk;
+  }
+  arena->chunks = chunk;
+  arena->reserved += sizeof(ArenaChunk) + chunk_size;
+  /* Chunks double in size so that big queues need few of them */
+  if (chunk_size < ARENA_MAX_CHUNK_SIZE) {
+    arena->next_chunk_size = chunk_size * 2;
+  }
+  return true;
+}
+
+void *ArenaAlloc(Arena *arena, size_t size) {
+  ArenaFreeBlock *block = NULL;
+  ArenaLarge *large = NULL;
+  ArenaChunk *chunk = NULL;
+  size_t class_idx = 0;
+  void *ptr = NULL;
+
+  if (arena == NULL) {
+    return NULL;
+  }
+  size = ArenaRoundUp(size);
+  if (size > ARENA_MAX_CLASS_SIZE) {
+    large = malloc(sizeof(ArenaLarge) + size);
+    if (large == NULL) {
+      return NULL;
+    }
+    large->size = size;
+    large->prev = NULL;
+    large->next = arena->large;
+    if (arena->large) {
+      arena->large->prev = large;
+    } else {
+      arena->large_tail = large;
+    }
+    arena->large = large;
+    arena->reserved += sizeof(ArenaLarge) + size;
+    arena->used += size;
+    return large + 1;
+  }
+  /* Reuses a returned block of the same size class */
+  class_idx = size / ARENA_ALIGN - 1;
+  if (arena->free_list[class_idx]) {
+    block = arena->free_list[class_idx];
+    arena->free_list[class_idx] = block->next;
+    if (block->next == NULL) {
+      arena->free_tail[class_idx] = NULL;
+    }
+    arena->used += size;
+    return block;
+  }
+  chunk = arena->chunks;
+  if (chunk == NULL || chunk->size - chunk->used < size) {
+    if (!ArenaGrow(arena, size)) {
+      return NULL;
+    }
+    chunk = arena->chunks;
+  }
+  ptr = chunk->data + chunk->used;
+  chunk->used += size;
+  arena->used += size;
+  return ptr;
+}
+
+void ArenaFree(Arena *arena, void *ptr, size_t size) {
+  ArenaFreeBlock *block = ptr;
+  ArenaLarge *large = NULL;
+  size_t class_idx = 0;
+
+  if (arena == NULL || ptr == NULL) {
+    return;
+  }
+  size = ArenaRoundUp(size);
+  arena->used -= size;
+  if (size > ARENA_MAX_CLASS_SIZE) {
+    large = (ArenaLarge *)ptr - 1;
+    if (large->prev) {
+      large->prev->next = large->next;
+    } else {
+      arena->large = large->next;
+    }
+    if (large->next) {
+      large->next->prev = large->prev;
+    } else {
+      arena->large_tail = large->prev;
+    }
+    arena->reserved -= sizeof(ArenaLarge) + large->size;
+    free(large);
+    return;
+  }
+  class_idx = size / ARENA_ALIGN - 1;
+  block->next = arena->free_list[class_idx];
+  if (block->next == NULL) {
+    arena->free_tail[class_idx] = block;
+  }
+  arena->free_list[class_idx] = block;
+}
+
+char *ArenaStrndup(Arena *arena, const char *str, size_t len) {
+  char *new_str = NULL;
+
+  if (arena == NULL || str == NULL) {
+    return NULL;
+  }
+  new_str = ArenaAlloc(arena, len + 1);
+  if (new_str == NULL) {
+    return NULL;
+  }
+  memcpy(new_str, str, len);
+  new_str[len] = '\0';
+  return new_str;
+}
+
+void ArenaRelease(Arena *arena) {
+  ArenaChunk *chunk = NULL;
+  ArenaLarge *large = NULL;
+
+  if (arena == NULL) {
+    return;
+  }
+  while (arena->chunks) {
+    chunk = arena->chunks;
+    arena->chunks = chunk->next;
+    free(chunk);
+  }
+  while (arena->large) {
+    large = arena->large;
+    arena->large = large->next;
+    free(large);
+  }
+  ArenaInit(arena);
+}
+
+void ArenaMerge(Arena *dst, Arena *src) {
+  if (dst == NULL || src == NULL || dst == src) {
+    return;
+  }
+  /* The first chunk of dst is the one carved next, so src's chunks go
+   * after it */
+  if (dst->chunks == NULL) {
+    dst->chunks = src->chunks;
+    dst->chunk_tail = src->chunk_tail;
+  } else if (src->chunks) {
+    src->chunk_tail->next = dst->chunks->next;
+    if (dst->chunks->next == NULL) {
+      dst->chunk_tail = src->chunk_tail;
+    }
+    dst->chunks->next = src->chunks;
+  }
+  if (src->large) {
+    src->large_tail->next = dst->large;
+    if (dst->large) {
+      dst->large->prev = src->large_tail;
+    } else {
+      dst->large_tail = src->large_tail;
+    }
+    dst->large = src->large;
+  }
+  for (int i = 0; i < ARENA_CLASS_NUM; i++) {
+    if (src->free_list[i]) {
+      src->free_tail[i]->next = dst->free_list[i];
+      if (dst->free_list[i] == NULL) {
+        dst->free_tail[i] = src->free_tail[i];
+      }
+      dst->free_list[i] = src->free_list[i];
+    }
+  }
+  if (src->next_chunk_size > dst->next_chunk_size) {
+    dst->next_chunk_size = src->next_chunk_size;
+  }
+  dst->reserved += src->reserved;
+  dst->used += src->used;
+  ArenaInit(src);
+}
+
+size_t ArenaReserved(const Arena *arena) {
+  if (arena == NULL) {
+    return 0;
+  }
+  return arena->reserved;
+}
+
+size_t ArenaUsed(const Arena *arena) {
+  if (arena == NULL) {
+    return 0;
+  }
+  return arena->used;
+}
@@ -0,0 +1,85 @@
+#ifndef INTERPRETER_ARENA_H_
+#define INTERPRETER_ARENA_H_
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#define ARENA_ALIGN 8                  /* Alignment of every block */
+#define ARENA_CLASS_NUM 32             /* Size classes: 8, 16, ..., 256 bytes */
+#define ARENA_MAX_CLASS_SIZE (ARENA_CLASS_NUM * ARENA_ALIGN)
+#define ARENA_MIN_CHUNK_SIZE (4 * 1024)   /* Size of the first chunk */
+#define ARENA_MAX_CHUNK_SIZE (1024 * 1024) /* Chunks stop doubling here */
+
+/* A large chunk of memory where small blocks are carved out */
+typedef struct ArenaChunk {
+  struct ArenaChunk *next;
+  size_t size; /* Bytes of data */
+  size_t used; /* Bytes of data carved out */
+  char data[];
+} ArenaChunk;
+
+/* A block bigger than ARENA_MAX_CLASS_SIZE, allocated by itself */
+typedef struct ArenaLarge {
+  struct ArenaLarge *prev;
+  struct ArenaLarge *next;
+  size_t size;
+} ArenaLarge;
+
+/* A returned block waiting to be reused */
+typedef struct ArenaFreeBlock {
+  struct ArenaFreeBlock *next;
+} ArenaFreeBlock;
+
+typedef struct Arena {
+  ArenaChunk *chunks;
+  ArenaLarge *large;
+  /* free_list[i] holds returned blocks of (i + 1) * ARENA_ALIGN bytes */
+  ArenaFreeBlock *free_list[ARENA_CLASS_NUM];
+  /* Last entries of the lists above, so that ArenaMerge() splices them
+   * in O(1) */
+  ArenaChunk *chunk_tail;
+  ArenaLarge *large_tail;
+  ArenaFreeBlock *free_tail[ARENA_CLASS_NUM];
+  size_t next_chunk_size;
+  /* Bytes reserved from the system */
+  size_t reserved;
+  /* Bytes handed out and not returned yet */
+  size_t used;
+} Arena;
+
+/* Initializes an empty arena
+ * No effect if arena is NULL */
+void ArenaInit(Arena *arena);
+
+/* Allocates size bytes from arena
+ * On success, return a pointer aligned to ARENA_ALIGN
+ * On error, return NULL */
+void *ArenaAlloc(Arena *arena, size_t size);
+
+/* Returns a block of size bytes to arena for reuse
+ * size must be the one passed to ArenaAlloc()
+ * No effect if arena or ptr is NULL */
+void ArenaFree(Arena *arena, void *ptr, size_t size);
+
+/* Copies the first len characters of str into arena
+ * On success, return a null-terminated copy
+ * On error, return NULL */
+char *ArenaStrndup(Arena *arena, const char *str, size_t len);
+
+/* Frees all memory of arena at once and leaves it empty
+ * No effect if arena is NULL */
+void ArenaRelease(Arena *arena);
+
+/* Hands all memory of src over to dst in O(1), leaving src empty, so
+ * that blocks allocated from src can be freed to dst
+ * No effect if dst or src is NULL or they are the same arena */
+void ArenaMerge(Arena *dst, Arena *src);
+
+/* Return bytes reserved from the system
+ * Return 0 if arena is NULL */
+size_t ArenaReserved(const Arena *arena);
+
+/* Return bytes handed out and not returned yet
+ * Return 0 if arena is NULL */
+size_t ArenaUsed(const Arena *arena);
+#endif
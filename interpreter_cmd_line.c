@@ -301,17 +301,19 @@ static bool CompleteCmdLine(CmdLineState *cls) {
   bool press_tab = false;
   size_t cmd_len = 0;
   CmdLineState cls_var;
-  CmdElementPtr cmd_list = g_cmd_list;
+  const char *cmd = NULL;
+  int cmd_idx = 0;
 
   if(!cls){
     return false;
   }
   cls_var = *cls;
 
-  while (isalpha(cls->buf[0]) && cmd_list) {
-    cmd_len = strlen(cmd_list->cmd);
-    if (cls->len <= cmd_len && strncmp(cls->buf, cmd_list->cmd, cls->len) == 0) {
-      strncpy(cls_var.buf, cmd_list->cmd, cmd_len);
+  while (isalpha(cls->buf[0]) && cmd_idx < g_cmd_num) {
+    cmd = g_cmd_table[cmd_idx].cmd;
+    cmd_len = strlen(cmd);
+    if (cls->len <= cmd_len && strncmp(cls->buf, cmd, cls->len) == 0) {
+      strncpy(cls_var.buf, cmd, cmd_len);
       cls_var.buf[cmd_len] = '\0';
       cls_var.len = cls_var.pos = cmd_len;
       Refresh(&cls_var);
@@ -334,7 +336,7 @@ static bool CompleteCmdLine(CmdLineState *cls) {
           strncpy(cls->buf, cls_var.buf, cls_var.len);
           cls->buf[cls_var.len] = '\0';
           cls->len = cls->pos = cls_var.len;
-          cmd_list = g_cmd_list;
+          cmd_idx = 0;
           break;
         case TAB:
           press_tab = true;
@@ -404,7 +406,7 @@ static bool CompleteCmdLine(CmdLineState *cls) {
           strncpy(cls->buf, cls_var.buf, cls_var.len);
           cls->buf[cls_var.len] = '\0';
           cls->len = cls->pos = cls_var.len;
-          cmd_list = g_cmd_list;
+          cmd_idx = 0;
           break;
         }
         if (c == TAB) {
@@ -412,9 +414,8 @@ static bool CompleteCmdLine(CmdLineState *cls) {
         }
       }
     }
-    cmd_list = cmd_list->next;
+    cmd_idx++;
   }
-  cmd_list = g_cmd_list;
   Refresh(cls);
   return false;
 }
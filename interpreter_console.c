@@ -5,207 +5,251 @@
 #include <unistd.h>
 #include <ctype.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <sys/wait.h>
 #include <time.h>
 #include "client/interpreter_client.h"
 #include "interpreter_cmd_line.h"
+#include "interpreter_intern.h"
+#include "interpreter_journal.h"
+#include "interpreter_latency.h"
 #include "interpreter_mem.h"
 #include "interpreter_msg.h"
 #include "interpreter_queue.h"
+#include "interpreter_random.h"
+#include "interpreter_registry.h"
+#include "interpreter_script.h"
 #include "interpreter_server.h"
+#include "interpreter_snapshot.h"
+#include "interpreter_token.h"
+
+#define RANDOM_STR_MIN_LEN 5 /* Min length of a random string */
+#define RANDOM_STR_MAX_LEN 10 /* Max length of a random string */
+#define INSERT_BATCH_NUM 65536 /* Strings inserted by one splice */
 
 const char g_history_file_name[] = ".history_cmd";
 char *g_input_file = NULL;
 bool g_quit = false;
-Queue *g_queue = NULL;
+QueueRegistry g_registry; /* Named queues */
+Queue *g_queue = NULL; /* Current queue of g_registry */
+Journal *g_journal = NULL; /* Journal of changes of g_registry if not NULL */
+/* How commands changing the queue show it */
+DisplayMode g_display_mode = DISPLAY_FULL;
+Random g_random; /* Generator of random strings */
+/* Latency of each command of g_cmd_table if tracked by -T */
+LatencyHist *g_latency = NULL;
+/* Arguments of the running command of a script parsed as numbers when it
+ * was compiled, NULL for other commands */
+const CmdNum *g_arg_nums = NULL;
 pid_t g_pid = -2; /* Server process ID; -2 is default value */
-CmdElementPtr g_cmd_list = NULL;
 
 /* Internal functions */
 static bool HelpOperation(int argc, char **argv);
 static bool QueueNewOperation(int argc, char **argv);
 static bool QueueFreeOperation(int argc, char **argv);
+static bool QueueUseOperation(int argc, char **argv);
+static bool QueueDropOperation(int argc, char **argv);
+static bool QueueListOperation(int argc, char **argv);
+static bool QueueConcatOperation(int argc, char **argv);
 static bool QueueInsertHeadOperation(int argc, char **argv);
 static bool QueueInsertTailOperation(int argc, char **argv);
 static bool QueueRemoveHeadOperation(int argc, char **argv);
 static bool QueueSizeOperation(int argc, char **argv);
+static bool QueueMemOperation(int argc, char **argv);
+static bool QueueStatsOperation(int argc, char **argv);
 static bool QueueReverseOperation(int argc, char **argv);
 static bool QueueSortOperation(int argc, char **argv);
+static bool QueueDedupOperation(int argc, char **argv);
+static bool QueueGetOperation(int argc, char **argv);
+static bool QueueSetOperation(int argc, char **argv);
+static bool QueueDeleteOperation(int argc, char **argv);
 static bool QueueShowOperation(int argc, char **argv);
+static bool QueueSaveOperation(int argc, char **argv);
+static bool QueueLoadOperation(int argc, char **argv);
+static bool DisplayOperation(int argc, char **argv);
 static bool ServerOperation(int argc, char **argv);
 static bool ClientOperation(int argc, char **argv);
 static bool QuitOperation(int argc, char **argv);
 static bool SleepOperation(int argc, char **argv);
-static bool AddCmd(char *cmd, char *doc, CmdFunction op);
-
-bool ConsoleInit() {
-  g_cmd_list = NULL;
-  srand(time(NULL)); /* For random string */
-  /* Adds commands into command list */
-  if(!AddCmd("help", "\t#Show documents", HelpOperation)){
-    QuitOperation(0, NULL);
-    return false;
-  }
-  if(!AddCmd("new", "\t#Create a queue", QueueNewOperation)){
-    QuitOperation(0, NULL);
-    return false;
-  }
-  if(!AddCmd("free", "\t#Delete a queue", QueueFreeOperation)){
-    QuitOperation(0, NULL);
-    return false;
-  }
-  if(!AddCmd("ih",
-          " str [n]\t#Insert n times of str at head, n>=1. Generate a string "
-          "if str is RAND",
-          QueueInsertHeadOperation)){
-    QuitOperation(0, NULL);
-    return false;
-  }
-  if(!AddCmd("it",
-          " str [n]\t#Insert n times of str at tail, n>=1. Generate a string "
-          "if str is RAND",
-          QueueInsertTailOperation)){
-    QuitOperation(0, NULL);
-    return false;
-  }
-  if(!AddCmd("rh", "\t#Remove the first element", QueueRemoveHeadOperation)){
-    QuitOperation(0, NULL);
-    return false;
-  }
-  if(!AddCmd("size", "\t#Show the size of queue", QueueSizeOperation)){
-    QuitOperation(0, NULL);
-    return false;
-  }
-  if(!AddCmd("reverse", "\t#Reverse the queue", QueueReverseOperation)){
-    QuitOperation(0, NULL);
-    return false;
-  }
-  if(!AddCmd("sort", "\t#Sort the queue", QueueSortOperation)){
-    QuitOperation(0, NULL);
-    return false;
-  }
-  if(!AddCmd("show", "\t#Show the queue", QueueShowOperation)){
-    QuitOperation(0, NULL);
-    return false;
-  }
-  if(!AddCmd("server", "\t#Activate server", ServerOperation)){
-    QuitOperation(0, NULL);
-    return false;
-  }
-  if(!AddCmd("client", "\t#Activate client", ClientOperation)){
-    QuitOperation(0, NULL);
-    return false;
-  }
-  if(!AddCmd("quit", "\t#Exit program", QuitOperation)){
-    QuitOperation(0, NULL);
-    return false;
-  }
-  if(!AddCmd("sleep", "\t#Program sleeps for 1 second", SleepOperation)){
-    QuitOperation(0, NULL);
-    return false;
+static bool TimeOperation(int argc, char **argv);
+static bool LatencyOperation(int argc, char **argv);
+static void CheckJournal(bool is_journaled);
+
+/* Commands in the order help shows them */
+const CmdElement g_cmd_table[] = {
+    {"help", "\t#Show documents", HelpOperation},
+    {"new", " [name] [-chunked|-sorted] [-intern]\t#Create a queue "
+     "named name, or replace the current one, and use it, a deque of "
+     "blocks if -chunked, kept in ascending order if -sorted, sharing "
+     "equal strings if -intern",
+     QueueNewOperation},
+    {"free", "\t#Delete a queue", QueueFreeOperation},
+    {"use", " name\t#Switch to the queue named name",
+     QueueUseOperation},
+    {"drop", " name\t#Delete the queue named name",
+     QueueDropOperation},
+    {"list", "\t#Show the names, sizes and kinds of queues",
+     QueueListOperation},
+    {"concat", " dst src\t#Move the elements of queue src to the "
+     "tail of queue dst, or merge them if both are sorted",
+     QueueConcatOperation},
+    {"ih",
+     " str [n] [-seed s]\t#Insert n times of str at head, n>=1. "
+     "Generate a string if str is RAND, from seed s if -seed s",
+     QueueInsertHeadOperation},
+    {"it",
+     " str [n] [-seed s]\t#Insert n times of str at tail, n>=1. "
+     "Generate a string if str is RAND, from seed s if -seed s",
+     QueueInsertTailOperation},
+    {"rh", "\t#Remove the first element", QueueRemoveHeadOperation},
+    {"size", "\t#Show the size of queue", QueueSizeOperation},
+    {"mem", "\t#Show memory reserved and used by the queue",
+     QueueMemOperation},
+    {"stats", "\t#Show memory of nodes and strings and string lengths",
+     QueueStatsOperation},
+    {"reverse", "\t#Reverse the queue", QueueReverseOperation},
+    {"sort",
+     " [-radix] [-j n]\t#Sort the queue, by radix sort if -radix, "
+     "on n threads if -j n",
+     QueueSortOperation},
+    {"dedup", "\t#Remove repeated elements, keeping the first of each",
+     QueueDedupOperation},
+    {"get", " i\t#Show the element at position i from head, i>=0",
+     QueueGetOperation},
+    {"set", " i str\t#Replace the element at position i by str",
+     QueueSetOperation},
+    {"del", " i\t#Remove the element at position i; get, set and del "
+     "need a chunked or sorted queue", QueueDeleteOperation},
+    {"show",
+     " [-from i] [-n n] [-summary]\t#Show the queue, n elements from "
+     "the i-th one if given, or its size, head and tail if -summary",
+     QueueShowOperation},
+    {"save", " file\t#Save the queue to a snapshot file",
+     QueueSaveOperation},
+    {"load", " file\t#Replace the queue by one loaded from a snapshot "
+     "file", QueueLoadOperation},
+    {"display", " [full|delta]\t#Show the whole queue or only what "
+     "changed and the size after a command changes it",
+     DisplayOperation},
+    {"server", "\t#Activate server", ServerOperation},
+    {"client", "\t#Activate client", ClientOperation},
+    {"quit", "\t#Exit program", QuitOperation},
+    {"sleep", "\t#Program sleeps for 1 second", SleepOperation},
+    {"time", " cmd [args]\t#Run cmd and show its wall and CPU time in "
+     "nanoseconds", TimeOperation},
+    {"latency", " [-csv file] [-reset]\t#Show percentiles of the latency "
+     "of each command tracked with -T, export them to a CSV file if "
+     "-csv file, or clear them if -reset",
+     LatencyOperation},
+};
+const int g_cmd_num = sizeof(g_cmd_table) / sizeof(g_cmd_table[0]);
+
+/* Every non-empty prefix of a command name, hashed into an open
+ * addressing table with linear probing, so that finding a command costs
+ * the same however many there are */
+typedef struct CmdIndexEntry {
+  uint64_t hash;
+  int16_t cmd; /* Index in g_cmd_table, -1 if the entry is empty */
+  uint8_t len; /* Length of the prefix */
+  bool is_exact; /* The prefix is the whole name of cmd */
+  bool is_ambiguous; /* The prefix is shared by other commands */
+} CmdIndexEntry;
+
+static CmdIndexEntry g_cmd_index[CMD_INDEX_SIZE];
+
+/* Return the entry of the prefix of name of len bytes, or the empty entry
+ * where it belongs if it's missing */
+static CmdIndexEntry *FindCmdIndex(const char *name, size_t len,
+                                   uint64_t hash) {
+  size_t idx = hash & (CMD_INDEX_SIZE - 1);
+  CmdIndexEntry *entry = NULL;
+
+  while ((entry = &g_cmd_index[idx])->cmd >= 0) {
+    if (entry->hash == hash && entry->len == len &&
+        memcmp(g_cmd_table[entry->cmd].cmd, name, len) == 0) {
+      break;
+    }
+    idx = (idx + 1) & (CMD_INDEX_SIZE - 1);
   }
-
-  return true;
+  return entry;
 }
 
-/* Trims leading and tailing spaces 
- * On success, returns a pointer to a copy string
- * Returns NULL if the input is NULL
- * The returned pointer needs to be freed by caller */
-char *TrimSpace(char *str) {
-  char *end = NULL;
-  char *new_str = NULL;
-  char *str_ptr = str;
-  size_t str_len = 0;
-
-  if (!str_ptr) {
-    return str_ptr;
-  }
-  /* Trim leading whitespace */
-  while (isspace(*str_ptr)) {
-    str_ptr++;
-  }
-  if (*str_ptr == '\0') {
-    /* Allocates new memory spaces to avoid possibly lost */
-    new_str = malloc(sizeof(char));
-    if(!IsMemAlloc(new_str)){
-      return NULL;
-    }
-    memset(new_str, 0, sizeof(char));
-    return new_str;
-  }
-  /* Trim tailing whitespace */
-  str_len = strlen(str_ptr);
-  end = str_ptr + str_len - 1;
-  while (end > str_ptr && isspace(*end)) {
-    end--;
-  }
-  *(end + 1) = '\0';
-
-  str_len = strlen(str_ptr);
-  /* allocating memory of str_len + 2 is for adding new line 
-     in the tail of command server and command client
-     getopt() needs new line */
-  new_str = malloc((str_len + 2) * sizeof(char));
-  if(!IsMemAlloc(new_str)){
-    return NULL;
+/* Indexes the prefixes of g_cmd_table
+ * On success, return true */
+static bool BuildCmdIndex() {
+  CmdIndexEntry *entry = NULL;
+  uint64_t hash = 0;
+  size_t cmd_len = 0;
+  int entry_num = 0;
+
+  for (int i = 0; i < CMD_INDEX_SIZE; i++) {
+    g_cmd_index[i].cmd = -1;
+  }
+  for (int i = 0; i < g_cmd_num; i++) {
+    cmd_len = strlen(g_cmd_table[i].cmd);
+    for (size_t len = 1; len <= cmd_len && len <= UINT8_MAX; len++) {
+      hash = InternHash(g_cmd_table[i].cmd, len);
+      entry = FindCmdIndex(g_cmd_table[i].cmd, len, hash);
+      if (entry->cmd < 0) {
+        /* Keeps the load factor at most 1/2 */
+        if (++entry_num * 2 > CMD_INDEX_SIZE) {
+          return false;
+        }
+        entry->hash = hash;
+        entry->cmd = i;
+        entry->len = len;
+        entry->is_exact = len == cmd_len;
+      } else if (len == cmd_len) {
+        /* A whole name wins over the longer names it's a prefix of */
+        entry->cmd = i;
+        entry->is_exact = true;
+        entry->is_ambiguous = false;
+      } else if (!entry->is_exact) {
+        entry->is_ambiguous = true;
+      }
+    }
   }
-  memset(new_str, 0, (str_len + 2) * sizeof(char));
-  strncpy(new_str, str_ptr, str_len);
-  new_str[str_len] = '\0';
-
-  return new_str;
+  return true;
 }
 
-char *TrimNewLine(char *str) {
-  char *str_ptr = str;
+const CmdElement *FindCmd(const char *name, bool is_prefix_allowed,
+                          bool *is_ambiguous) {
+  CmdIndexEntry *entry = NULL;
+  size_t len = 0;
 
-  if (!str) {
-    return str;
+  if (is_ambiguous) {
+    *is_ambiguous = false;
   }
-  while (*str_ptr != '\n' && *str_ptr != '\0') {
-    str_ptr++;
+  if (name == NULL) {
+    return NULL;
   }
-  *str_ptr = '\0';
-
-  return str;
-}
-
-/* Split cmd into strings by space 
- * For example, cmd = "server -p 9999", 
-   argv will be ["server", "-p", "9999"]
- * On success, returns a pointer of pointer to strings 
- * On error, returns NULL */
-static char **SplitCmd(int *argc, char *cmd) {
-  size_t args_max_num = 8;
-  const char delim[] = " ";
-  char **argv = NULL;
-  char **argv_ptr = NULL;
-
-  if (!cmd || !argc){
+  len = strlen(name);
+  if (len == 0 || len > UINT8_MAX) {
     return NULL;
   }
-
-  argv = malloc((args_max_num + 1) * sizeof(char *));
-  if(!IsMemAlloc(argv)){
+  entry = FindCmdIndex(name, len, InternHash(name, len));
+  if (entry->cmd < 0 || (!entry->is_exact && !is_prefix_allowed)) {
     return NULL;
   }
-  memset(argv, 0, (args_max_num + 1) * sizeof(char *));
-  argv_ptr = argv;
-
-  (*argc)++;
-  *argv_ptr = strtok(cmd, delim);
-  while ((*argc) < args_max_num && *argv_ptr++) {
-    *argv_ptr = strtok(NULL, delim);
-    if (strncmp("server", cmd, 6) != 0 && strncmp("client", cmd, 6) != 0) {
-      *argv_ptr = TrimNewLine(*argv_ptr);
-    }
-    if (*argv_ptr) {
-      (*argc)++;
+  if (!entry->is_exact && entry->is_ambiguous) {
+    if (is_ambiguous) {
+      *is_ambiguous = true;
     }
+    return NULL;
   }
+  return &g_cmd_table[entry->cmd];
+}
 
-  return argv;
+bool ConsoleInit() {
+  RegistryInit(&g_registry);
+  RandomSeed(&g_random, time(NULL)); /* For random string */
+  if (!BuildCmdIndex()) {
+    ShowMsg("too many commands for the command index\n");
+    QuitOperation(0, NULL);
+    return false;
+  }
+
+  return true;
 }
 
 static bool IsQueueNULL() {
@@ -217,29 +261,91 @@ static bool IsQueueNULL() {
   return false;
 }
 
+/* Return argv[idx] as atoi() does, taking the number parsed when its
+ * script was compiled if there is one */
+static int ArgToInt(char **argv, int idx) {
+  if (g_arg_nums && g_arg_nums[idx].is_num) {
+    return g_arg_nums[idx].value;
+  }
+  return atoi(argv[idx]);
+}
+
 /* Show all commands and document of these commands */
 static bool HelpOperation(int argc, char **argv) {
-  CmdElementPtr cmd_list = g_cmd_list;
-
   printf("\tCommand\tDescription\n");
   fflush(stdout);
 
-  while (cmd_list) {
-    printf("\t%s%s\n", cmd_list->cmd, cmd_list->doc);
+  for (int i = 0; i < g_cmd_num; i++) {
+    printf("\t%s%s\n", g_cmd_table[i].cmd, g_cmd_table[i].doc);
     fflush(stdout);
-    cmd_list = cmd_list->next;
   }
 
   return true;
 }
 
+/* Renders num elements of queue from the from-th one into buf, with
+ * "..." standing for elements left out at either end
+ * On success, return true */
+static bool RenderQueue(MsgBuf *buf, int from, int num) {
+  QueueIter iter;
+  const char *value = NULL;
+  const char *end = NULL;
+  int size = QueueSize(g_queue);
+  bool is_rendered = MsgBufAppend(buf, "queue = [", 9);
+
+  if (from > 0) {
+    is_rendered = is_rendered && MsgBufAppend(buf, "...", 3);
+  }
+  QueueIterInit(&iter, g_queue);
+  QueueIterSeek(&iter, from);
+  for (int i = 0; i < num && (value = QueueIterNext(&iter)) != NULL; i++) {
+    if (from > 0 || i > 0) {
+      is_rendered = is_rendered && MsgBufAppend(buf, ", ", 2);
+    }
+    is_rendered = is_rendered && MsgBufAppend(buf, value, strlen(value));
+  }
+  if (from + num >= size || (from > 0 && num == 0)) {
+    end = "]\n";
+  } else if (num > 0) {
+    end = ", ...]\n";
+  } else {
+    end = "...]\n";
+  }
+  return is_rendered && MsgBufAppend(buf, end, strlen(end));
+}
+
+/* Renders size, head and tail of queue into buf
+ * On success, return true */
+static bool RenderQueueSummary(MsgBuf *buf) {
+  const char *head = NULL;
+  const char *tail = NULL;
+  int size = QueueSize(g_queue);
+
+  if (size == 0) {
+    return MsgBufPrintf(buf, "queue has 0 elements\n");
+  }
+  /* Both ends are reached without walking the queue */
+  head = QueueGet(g_queue, 0);
+  tail = QueueGet(g_queue, size - 1);
+  return MsgBufPrintf(buf, "queue has %d elements, head = %s, tail = %s\n",
+                      size, head, tail);
+}
+
 /* Shows elements of queue 
+ * "show" takes "-from I" to start at the I-th element, "-n N" to show N
+ * elements at most and "-summary" to show size, head and tail only
+ * The output is rendered in memory and written at once
  * On success, returns true*/
 static bool QueueShowOperation(int argc, char **argv) {
-  ListElement *head = g_queue->head;
+  MsgBuf buf;
   bool is_visible = g_is_visible;
   size_t show_len = 4;
   bool is_show_cmd = false;
+  bool is_summary = false;
+  bool is_rendered = true;
+  int from = 0;
+  int num = -1; /* All elements */
+  int size = 0;
 
   if (IsQueueNULL()) {
     return true;
@@ -250,41 +356,128 @@ static bool QueueShowOperation(int argc, char **argv) {
 
   if(strlen(*argv) == show_len && strncmp(*argv, "show", show_len) == 0){
     is_show_cmd = true;
+    for (int i = 1; i < argc && argv[i]; i++) {
+      if (strcmp(argv[i], "-summary") == 0) {
+        is_summary = true;
+      } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc && argv[i + 1]) {
+        num = ArgToInt(argv, ++i);
+      } else if (strcmp(argv[i], "-from") == 0 && i + 1 < argc &&
+                 argv[i + 1]) {
+        from = ArgToInt(argv, ++i);
+      } else {
+        ShowMsg("unknown option %s\n", argv[i]);
+        return false;
+      }
+      if (num < -1 || from < 0) {
+        ShowMsg("number must not be negative\n");
+        return false;
+      }
+    }
     g_is_visible = true;
   }
 
   if (g_is_visible || g_log_file) {
-    if (head && head->value) {
-      ShowMsg("queue = [%s", head->value);
-      head = head->next;
+    size = QueueSize(g_queue);
+    from = from < size ? from : size;
+    num = num < 0 || num > size - from ? size - from : num;
+    MsgBufInit(&buf);
+    if (is_summary) {
+      is_rendered = RenderQueueSummary(&buf);
     } else {
-      ShowMsg("queue = [");
+      is_rendered = RenderQueue(&buf, from, num);
     }
-    while (head) {
-      ShowMsg(", %s", head->value);
-      head = head->next;
+    if (is_rendered) {
+      ShowMsgBuf(&buf);
+    } else {
+      ShowMsg("show the queue failed\n");
     }
-    ShowMsg("]\n");
+    MsgBufFree(&buf);
   }
 
   if(is_show_cmd){
     g_is_visible = is_visible;
   }
 
-  return true;
+  return is_rendered;
+}
+
+/* Return true if a change is shown in delta display mode, so that a
+ * command renders what it changed */
+static bool IsChangeShown() {
+  return g_display_mode == DISPLAY_DELTA && (g_is_visible || g_log_file);
 }
 
+/* Shows the queue after a command changed it: the whole queue in full
+ * display mode, otherwise change and the size of the queue
+ * change is freed */
+static void QueueShowChange(int argc, char **argv, MsgBuf *change) {
+  if (g_display_mode == DISPLAY_FULL) {
+    QueueShowOperation(argc, argv);
+  } else if (IsChangeShown() &&
+             MsgBufPrintf(change, ", size = %d\n", QueueSize(g_queue))) {
+    ShowMsgBuf(change);
+  }
+  MsgBufFree(change);
+}
+
+/* Creates a queue named by the first argument that is not an option, or
+ * replaces the current queue, and makes it current
+ * It's a chunked queue if "-chunked" is given, a sorted queue if "-sorted"
+ * is given and one sharing equal strings if "-intern" is given
+ * On success, return true */
 static bool QueueNewOperation(int argc, char **argv) {
-  if (g_queue) {
-    free(g_queue);
-    g_queue = NULL;
+  MsgBuf change;
+  QueueKind kind = QUEUE_LIST;
+  const char *name = NULL;
+  Queue *queue = NULL;
+  bool is_interned = false;
+
+  for (int i = 1; i < argc && argv[i]; i++) {
+    if ((strcmp(argv[i], "-chunked") == 0 ||
+         strcmp(argv[i], "-sorted") == 0) && kind != QUEUE_LIST) {
+      ShowMsg("-chunked and -sorted can not be used together\n");
+      return false;
+    } else if (strcmp(argv[i], "-chunked") == 0) {
+      kind = QUEUE_CHUNKED;
+    } else if (strcmp(argv[i], "-sorted") == 0) {
+      kind = QUEUE_SORTED;
+    } else if (strcmp(argv[i], "-intern") == 0) {
+      is_interned = true;
+    } else if (argv[i][0] != '-' && name == NULL) {
+      name = argv[i];
+    } else {
+      ShowMsg("unknown option %s\n", argv[i]);
+      return false;
+    }
   }
 
-  g_queue = QueueNew();
-  if (!IsMemAlloc(g_queue)) {
+  queue = QueueNewKind(kind);
+  if (!IsMemAlloc(queue)) {
+    return false;
+  }
+  if (is_interned) {
+    QueueEnableIntern(queue);
+  }
+  if (name && !RegistryUse(&g_registry, name)) {
+    ShowMsg("memory allocation failed\n");
+    QueueFree(queue);
+    return false;
+  }
+  name = RegistryCurrentName(&g_registry);
+  /* Registering frees the queue replaced */
+  if (!RegistryPut(&g_registry, name, queue)) {
+    ShowMsg("memory allocation failed\n");
+    QueueFree(queue);
+    g_queue = RegistryCurrent(&g_registry);
+    CheckJournal(JournalNames(g_journal, JOURNAL_USE, name, NULL));
     return false;
   }
-  QueueShowOperation(argc, argv);
+  g_queue = queue;
+  CheckJournal(
+      JournalNew(g_journal, SnapshotFlags(kind, is_interned), name));
+  MsgBufInit(&change);
+  MsgBufPrintf(&change, "new");
+  QueueShowChange(argc, argv, &change);
 
   return true;
 }
@@ -294,99 +487,169 @@ static bool QueueFreeOperation(int argc, char **argv) {
     return true;
   }
 
-  QueueFree(g_queue);
+  QueueFree(RegistryTake(&g_registry, RegistryCurrentName(&g_registry)));
   g_queue = NULL;
+  CheckJournal(JournalAppend(g_journal, JOURNAL_FREE));
   ShowMsg("the queue is freed\n");
 
   return true;
 }
 
-/* Generates a random string whose length is between 5 and 10 
- * On success, return the string
- * On error, return NULL 
- * The returned pointer needs to be freed by caller */
-char *RandomString() {
-  const char alphabets[] = "abcdefghijklmnopqrstuvwxyz";
-  size_t max_str_len = 10;
-  size_t min_str_len = 5;
-  size_t str_len = 0;
-  char *str = NULL;
+/* Makes the queue named argv[1] current
+ * On success, return true */
+static bool QueueUseOperation(int argc, char **argv) {
+  Queue *queue = NULL;
 
-  while (str_len < min_str_len) {
-    str_len = rand() % (max_str_len + 1);
+  if (argc < 2 || argv[1] == NULL) {
+    ShowMsg("use needs a queue name\n");
+    return false;
   }
-
-  str = malloc((str_len + 1) * sizeof(char));
-  if (!IsMemAlloc(str)) {
-    return NULL;
+  queue = RegistryGet(&g_registry, argv[1]);
+  if (queue == NULL) {
+    ShowMsg("there is no queue named %s\n", argv[1]);
+    return false;
   }
-  memset(str, 0, (str_len + 1) * sizeof(char));
 
-  for (int i = 0; i < str_len; i++) {
-    str[i] = alphabets[rand() % 26];
+  if (!RegistryUse(&g_registry, argv[1])) {
+    ShowMsg("memory allocation failed\n");
+    return false;
   }
-  str[str_len] = '\0';
+  g_queue = queue;
+  CheckJournal(JournalNames(g_journal, JOURNAL_USE, argv[1], NULL));
+  ShowMsg("using queue %s, size = %d\n", argv[1], QueueSize(g_queue));
 
-  return str;
+  return true;
 }
 
-/* Inserts str at head of queue num times
- * str is random string if argv[1] is "RAND"
+/* Deletes the queue named argv[1]
  * On success, return true */
-static bool QueueInsertHeadOperation(int argc, char **argv) {
-  int num = 1;
-  char *str = NULL;
-  bool is_random = false;
+static bool QueueDropOperation(int argc, char **argv) {
+  Queue *queue = NULL;
 
-  if(IsQueueNULL()){
+  if (argc < 2 || argv[1] == NULL) {
+    ShowMsg("drop needs a queue name\n");
+    return false;
+  }
+  queue = RegistryTake(&g_registry, argv[1]);
+  if (queue == NULL) {
+    ShowMsg("there is no queue named %s\n", argv[1]);
+    return false;
+  }
+
+  if (queue == g_queue) {
+    g_queue = NULL;
+  }
+  QueueFree(queue);
+  CheckJournal(JournalNames(g_journal, JOURNAL_DROP, argv[1], NULL));
+  ShowMsg("queue %s is dropped\n", argv[1]);
+
+  return true;
+}
+
+/* Shows the queues in order of name, the current one marked by '*'
+ * On success, return true */
+static bool QueueListOperation(int argc, char **argv) {
+  static const char *kind_names[] = {"list", "chunked", "sorted"};
+  RegistryEntry *list = NULL;
+  MsgBuf buf;
+  bool is_rendered = true;
+
+  if (g_registry.num == 0) {
+    ShowMsg("there is no queue\n");
     return true;
   }
-  if (argc < 2 || !argv) {
+  list = RegistryList(&g_registry);
+  if (!IsMemAlloc(list)) {
     return false;
   }
-  if (argc > 2 && argv[2]) {
-    num = atoi(argv[2]);
-    if (num < 1) {
-      ShowMsg("number must be greater than 0\n");
-      return false;
-    }
+
+  MsgBufInit(&buf);
+  for (size_t i = 0; i < g_registry.num && is_rendered; i++) {
+    is_rendered = MsgBufPrintf(
+        &buf, "%c %s: size = %d, %s%s\n",
+        list[i].queue == g_queue ? '*' : ' ', list[i].name,
+        QueueSize(list[i].queue), kind_names[list[i].queue->kind],
+        list[i].queue->is_interned ? ", interned" : "");
   }
-  if(*(argv + 1)){
-    if (strlen(*(argv + 1)) == 4 && strncmp("RAND", *(argv + 1), 4) == 0) {
-      is_random = true;
-    } else {
-      str = *(argv + 1);
-    }
-  }else{
+  if (is_rendered) {
+    ShowMsgBuf(&buf);
+  } else {
+    ShowMsg("list the queues failed\n");
+  }
+  MsgBufFree(&buf);
+  free(list);
+
+  return is_rendered;
+}
+
+/* Moves the elements of queue argv[2] to the tail of queue argv[1], or
+ * merges them if both are sorted, leaving argv[2] empty
+ * On success, return true */
+static bool QueueConcatOperation(int argc, char **argv) {
+  MsgBuf change;
+  Queue *dst = NULL;
+  Queue *src = NULL;
+  int src_size = 0;
+
+  if (argc < 3 || argv[1] == NULL || argv[2] == NULL) {
+    ShowMsg("concat needs two queue names\n");
     return false;
   }
-  for (int i = 0; i < num; i++) {
-    if (is_random) {
-      str = RandomString();
-    }
-    if (!QueueInsertHead(g_queue, str)) {
-      ShowMsg("insert a string at the head of queue failed\n");
-      if (is_random) {
-        free(str);
-      }
-      return false;
-    }
-    if (is_random) {
-      free(str);
-    }
+  dst = RegistryGet(&g_registry, argv[1]);
+  src = RegistryGet(&g_registry, argv[2]);
+  if (dst == NULL || src == NULL) {
+    ShowMsg("there is no queue named %s\n", dst ? argv[2] : argv[1]);
+    return false;
+  }
+  if (dst == src) {
+    ShowMsg("a queue can not be concatenated to itself\n");
+    return false;
+  }
+  if (dst->kind != src->kind) {
+    ShowMsg("queues of different kinds can not be concatenated\n");
+    return false;
+  }
+  if (dst->is_interned || src->is_interned) {
+    ShowMsg("interned queues can not be concatenated\n");
+    return false;
+  }
+
+  src_size = QueueSize(src);
+  if (!QueueConcat(dst, src)) {
+    ShowMsg("concat %s to %s failed\n", argv[2], argv[1]);
+    return false;
   }
-  QueueShowOperation(argc, argv);
+  CheckJournal(JournalNames(g_journal, JOURNAL_CONCAT, argv[1], argv[2]));
+  if (dst != g_queue) {
+    ShowMsg("%d elements of %s are moved to %s, size = %d\n", src_size,
+            argv[2], argv[1], QueueSize(dst));
+    return true;
+  }
+  MsgBufInit(&change);
+  MsgBufPrintf(&change, "+%d from %s", src_size, argv[2]);
+  QueueShowChange(argc, argv, &change);
 
   return true;
 }
 
-/* Inserts str at tail of queue 
- * str is random string if argv[1] is "RAND" 
+/* Inserts str num times at head of queue if at_head is true, otherwise
+ * at tail
+ * str is random string if argv[1] is "RAND", generated from seed S if
+ * "-seed S" is given
+ * Strings are inserted INSERT_BATCH_NUM at a time by one splice
  * On success, return true */
-static bool QueueInsertTailOperation(int argc, char **argv) {
+static bool QueueInsertOperation(int argc, char **argv, bool at_head) {
+  MsgBuf change;
   int num = 1;
+  int batch_num = 0;
+  int count = 0;
   char *str = NULL;
+  char *buf = NULL;
+  size_t str_size = 0;
   bool is_random = false;
+  bool is_inserted = false;
+  bool is_seeded = false;
+  uint64_t seed = 0;
 
   if(IsQueueNULL()){
     return true;
@@ -394,58 +657,139 @@ static bool QueueInsertTailOperation(int argc, char **argv) {
   if (argc < 2 || !argv) {
     return false;
   }
-  if (argc > 2 && argv[2]) {
-    num = atoi(argv[2]);
-    if (num < 1) {
-      ShowMsg("number must be greater than 0\n");
-      return false;
+  for (int i = 2; i < argc && argv[i]; i++) {
+    if (strcmp(argv[i], "-seed") == 0 && i + 1 < argc && argv[i + 1]) {
+      seed = strtoull(argv[++i], NULL, 0);
+      is_seeded = true;
+    } else {
+      num = ArgToInt(argv, i);
+      if (num < 1) {
+        ShowMsg("number must be greater than 0\n");
+        return false;
+      }
     }
   }
   if(*(argv + 1)){
     if (strlen(*(argv + 1)) == 4 && strncmp("RAND", *(argv + 1), 4) == 0) {
       is_random = true;
+      str_size = RANDOM_STR_MAX_LEN + 1;
     } else {
       str = *(argv + 1);
+      str_size = strlen(str) + 1;
     }
   }else{
     return false;
   }
-  for (int i = 0; i < num; i++) {
+  if (is_seeded && !is_random) {
+    ShowMsg("-seed is for RAND only\n");
+    return false;
+  }
+  if (is_seeded) {
+    RandomSeed(&g_random, seed);
+  }
+  batch_num = num < INSERT_BATCH_NUM ? num : INSERT_BATCH_NUM;
+  buf = malloc(batch_num * str_size * sizeof(char));
+  if (!IsMemAlloc(buf)) {
+    return false;
+  }
+  MsgBufInit(&change);
+  if (IsChangeShown()) {
+    MsgBufPrintf(&change, at_head ? "+head " : "+tail ");
     if (is_random) {
-      str = RandomString();
+      MsgBufAppend(&change, "[", 1);
+    } else if (num > 1) {
+      MsgBufPrintf(&change, "%s x%d", str, num);
+    } else {
+      MsgBufAppend(&change, str, str_size - 1);
     }
-    if (!QueueInsertTail(g_queue, str)) {
-      ShowMsg("insert a string at the tail of queue failed\n");
-      if (is_random) {
-        free(str);
-      }
-      return false;
+  }
+  /* A given string is packed once and the batch is reused */
+  if (!is_random) {
+    for (int i = 0; i < batch_num; i++) {
+      memcpy(buf + i * str_size, str, str_size);
     }
+  }
+  for (int left = num; left > 0; left -= count) {
+    count = left < batch_num ? left : batch_num;
     if (is_random) {
-      free(str);
+      RandomStrings(&g_random, buf, count, RANDOM_STR_MIN_LEN,
+                    RANDOM_STR_MAX_LEN);
+      /* Random strings are the change to show as they are unknown */
+      for (int i = 0, offset = 0; i < count && IsChangeShown(); i++) {
+        if (i > 0 || left < num) {
+          MsgBufAppend(&change, ", ", 2);
+        }
+        MsgBufAppend(&change, buf + offset, strlen(buf + offset));
+        offset += strlen(buf + offset) + 1;
+      }
+    }
+    if (at_head) {
+      is_inserted = QueueInsertHeadBatch(g_queue, buf, count);
+    } else {
+      is_inserted = QueueInsertTailBatch(g_queue, buf, count);
+    }
+    if (!is_inserted) {
+      ShowMsg("insert a string at the %s of queue failed\n",
+              at_head ? "head" : "tail");
+      MsgBufFree(&change);
+      free(buf);
+      return false;
     }
+    /* A given string is journaled once with the times it's inserted */
+    CheckJournal(JournalInsert(g_journal, at_head, buf, is_random ? count : 1,
+                               is_random ? 1 : count));
+  }
+  free(buf);
+  if (is_random && IsChangeShown()) {
+    MsgBufAppend(&change, "]", 1);
   }
-  QueueShowOperation(argc, argv);
+  QueueShowChange(argc, argv, &change);
 
   return true;
 }
 
+/* Inserts str at head of queue num times
+ * str is random string if argv[1] is "RAND"
+ * On success, return true */
+static bool QueueInsertHeadOperation(int argc, char **argv) {
+  return QueueInsertOperation(argc, argv, true);
+}
+
+/* Inserts str at tail of queue 
+ * str is random string if argv[1] is "RAND" 
+ * On success, return true */
+static bool QueueInsertTailOperation(int argc, char **argv) {
+  return QueueInsertOperation(argc, argv, false);
+}
+
 /* Removes the first element of queue 
  * On success, return true */
 static bool QueueRemoveHeadOperation(int argc, char **argv) {
+  MsgBuf change;
+  QueueIter iter;
+
   if (IsQueueNULL()) {
     return true;
   }
 
-  if (!g_queue->head) {
-    QueueShowOperation(argc, argv);
+  MsgBufInit(&change);
+  if (QueueSize(g_queue) == 0) {
+    MsgBufPrintf(&change, "-head nothing");
+    QueueShowChange(argc, argv, &change);
     return true;
   }
+  /* The removed string is rendered while it's still there */
+  if (IsChangeShown()) {
+    QueueIterInit(&iter, g_queue);
+    MsgBufPrintf(&change, "-head %s", QueueIterNext(&iter));
+  }
   if (!QueueRemoveHead(g_queue)) {
     ShowMsg("remove the first element failed\n");
+    MsgBufFree(&change);
     return false;
   }
-  QueueShowOperation(argc, argv);
+  CheckJournal(JournalAppend(g_journal, JOURNAL_REMOVE_HEAD));
+  QueueShowChange(argc, argv, &change);
 
   return true;
 }
@@ -462,28 +806,331 @@ static bool QueueSizeOperation(int argc, char **argv) {
   return true;
 }
 
+/* Shows bytes reserved from the system and bytes used by queue
+ * On success, return true */
+static bool QueueMemOperation(int argc, char **argv) {
+  size_t reserved = 0;
+  size_t used = 0;
+
+  if (IsQueueNULL()) {
+    return true;
+  }
+
+  QueueMemUsage(g_queue, &reserved, &used);
+  ShowMsg("the queue reserves %zu bytes and uses %zu bytes\n", reserved, used);
+
+  return true;
+}
+
+/* Shows memory accounting of queue, which costs O(1) whatever its size
+ * On success, return true */
+static bool QueueStatsOperation(int argc, char **argv) {
+  QueueStats stats;
+  MsgBuf buf;
+
+  if (IsQueueNULL()) {
+    return true;
+  }
+
+  QueueGetStats(g_queue, &stats);
+  MsgBufInit(&buf);
+  MsgBufPrintf(&buf, "nodes: %zu bytes, peak %zu bytes\n", stats.node_bytes,
+               stats.node_peak);
+  MsgBufPrintf(&buf, "strings: %zu bytes, peak %zu bytes\n",
+               stats.string_bytes, stats.string_peak);
+  MsgBufPrintf(&buf, "overhead: %zu bytes, peak %zu bytes\n",
+               stats.overhead_bytes, stats.overhead_peak);
+  if (stats.mapped_bytes > 0) {
+    MsgBufPrintf(&buf, "mapped: %zu bytes\n", stats.mapped_bytes);
+  }
+  MsgBufPrintf(&buf, "string length: average %.2f, max %zu\n",
+               stats.avg_len, stats.max_len);
+  ShowMsgBuf(&buf);
+  MsgBufFree(&buf);
+
+  return true;
+}
+
 /* Reverses the queue 
  * On success, return true */
 static bool QueueReverseOperation(int argc, char **argv) {
+  MsgBuf change;
+
   if (IsQueueNULL()) {
     return true;
   }
 
+  if (g_queue->kind == QUEUE_SORTED) {
+    ShowMsg("a sorted queue can not be reversed\n");
+    return false;
+  }
   QueueReverse(g_queue);
-  QueueShowOperation(argc, argv);
+  CheckJournal(JournalAppend(g_journal, JOURNAL_REVERSE));
+  MsgBufInit(&change);
+  MsgBufPrintf(&change, "reverse");
+  QueueShowChange(argc, argv, &change);
 
   return true;
 }
 
-/* Sorts the queue
+/* Sorts the queue, by radix sort if "-radix" is given and on N threads
+ * if "-j N" is given
  * On success, return true */
 static bool QueueSortOperation(int argc, char **argv) {
+  MsgBuf change;
+  SortMode mode = SORT_MERGE;
+  SortStats stats;
+  int thread_num = 1;
+
+  if (IsQueueNULL()) {
+    return true;
+  }
+  for (int i = 1; i < argc && argv[i]; i++) {
+    if (strcmp(argv[i], "-radix") == 0) {
+      mode = SORT_RADIX;
+    } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc && argv[i + 1]) {
+      thread_num = ArgToInt(argv, ++i);
+      if (thread_num < 1) {
+        ShowMsg("number of threads must be greater than 0\n");
+        return false;
+      }
+    } else {
+      ShowMsg("unknown option %s\n", argv[i]);
+      return false;
+    }
+  }
+
+  if (!QueueSortParallel(g_queue, mode, thread_num, &stats)) {
+    ShowMsg("sort the queue failed\n");
+    return false;
+  }
+  /* A sorted queue is not sorted again, so there is nothing to time */
+  if (thread_num > 1 && g_queue->kind != QUEUE_SORTED) {
+    ShowMsg("sort took gather %.3fs, sort %.3fs on %d threads, "
+            "merge %.3fs, relink %.3fs\n",
+            stats.gather_time, stats.sort_time, stats.thread_num,
+            stats.merge_time, stats.scatter_time);
+  }
+  CheckJournal(JournalAppend(g_journal, JOURNAL_SORT));
+  MsgBufInit(&change);
+  MsgBufPrintf(&change, "sort");
+  QueueShowChange(argc, argv, &change);
+
+  return true;
+}
+
+/* Removes repeated elements of the queue
+ * On success, return true */
+static bool QueueDedupOperation(int argc, char **argv) {
+  MsgBuf change;
+  int removed_num = 0;
+
+  if (IsQueueNULL()) {
+    return true;
+  }
+
+  if (!QueueDedup(g_queue, &removed_num)) {
+    ShowMsg("dedup the queue failed\n");
+    return false;
+  }
+  CheckJournal(JournalAppend(g_journal, JOURNAL_DEDUP));
+  MsgBufInit(&change);
+  MsgBufPrintf(&change, "dedup -%d", removed_num);
+  QueueShowChange(argc, argv, &change);
+
+  return true;
+}
+
+/* Return true if an element of queue is found by its position in
+ * O(log n), i.e., queue is chunked or sorted; a list queue would be
+ * walked, so positions are refused on it */
+static bool IsQueueIndexed() {
+  if (g_queue->kind == QUEUE_LIST) {
+    ShowMsg("positions of a list queue are not indexed, "
+            "use new -chunked or new -sorted\n");
+    return false;
+  }
+
+  return true;
+}
+
+/* Parses argv[1], a position of an element of queue, into *idx, taking
+ * the number parsed when its script was compiled if there is one
+ * Return false if argv[1] is not a position in queue */
+static bool ParseIndex(int argc, char **argv, int *idx) {
+  char *end = NULL;
+  long value = 0;
+
+  if (argc < 2 || argv[1] == NULL) {
+    ShowMsg("a position is needed\n");
+    return false;
+  }
+  if (g_arg_nums && g_arg_nums[1].is_num) {
+    value = g_arg_nums[1].value;
+  } else {
+    value = strtol(argv[1], &end, 10);
+    if (end == argv[1] || *end != '\0') {
+      value = -1;
+    }
+  }
+  if (value < 0 || value >= QueueSize(g_queue)) {
+    ShowMsg("position %s is out of range [0, %d)\n", argv[1],
+            QueueSize(g_queue));
+    return false;
+  }
+  *idx = value;
+  return true;
+}
+
+/* Shows the element at position argv[1] of queue
+ * On success, return true */
+static bool QueueGetOperation(int argc, char **argv) {
+  int idx = 0;
+
+  if (IsQueueNULL()) {
+    return true;
+  }
+  if (!IsQueueIndexed() || !ParseIndex(argc, argv, &idx)) {
+    return false;
+  }
+
+  ShowMsg("queue[%d] = %s\n", idx, QueueGet(g_queue, idx));
+
+  return true;
+}
+
+/* Replaces the element at position argv[1] of queue by argv[2]
+ * On success, return true */
+static bool QueueSetOperation(int argc, char **argv) {
+  MsgBuf change;
+  int idx = 0;
+
+  if (IsQueueNULL()) {
+    return true;
+  }
+  if (g_queue->kind == QUEUE_SORTED) {
+    ShowMsg("an element of a sorted queue can not be set\n");
+    return false;
+  }
+  if (!IsQueueIndexed() || !ParseIndex(argc, argv, &idx)) {
+    return false;
+  }
+  if (argc < 3 || argv[2] == NULL) {
+    ShowMsg("set needs a string\n");
+    return false;
+  }
+
+  if (!QueueSet(g_queue, idx, argv[2])) {
+    ShowMsg("set the element at %d failed\n", idx);
+    return false;
+  }
+  CheckJournal(JournalSet(g_journal, idx, argv[2]));
+  MsgBufInit(&change);
+  MsgBufPrintf(&change, "set [%d] %s", idx, argv[2]);
+  QueueShowChange(argc, argv, &change);
+
+  return true;
+}
+
+/* Removes the element at position argv[1] of queue
+ * On success, return true */
+static bool QueueDeleteOperation(int argc, char **argv) {
+  MsgBuf change;
+  int idx = 0;
+
+  if (IsQueueNULL()) {
+    return true;
+  }
+  if (!IsQueueIndexed() || !ParseIndex(argc, argv, &idx)) {
+    return false;
+  }
+
+  MsgBufInit(&change);
+  /* The removed string is rendered while it's still there */
+  if (IsChangeShown()) {
+    MsgBufPrintf(&change, "-[%d] %s", idx, QueueGet(g_queue, idx));
+  }
+  if (!QueueDelete(g_queue, idx)) {
+    ShowMsg("remove the element at %d failed\n", idx);
+    MsgBufFree(&change);
+    return false;
+  }
+  CheckJournal(JournalDelete(g_journal, idx));
+  QueueShowChange(argc, argv, &change);
+
+  return true;
+}
+
+/* Saves the queue to snapshot file argv[1]
+ * On success, return true */
+static bool QueueSaveOperation(int argc, char **argv) {
   if (IsQueueNULL()) {
     return true;
   }
+  if (argc < 2 || argv[1] == NULL) {
+    ShowMsg("save needs a file name\n");
+    return false;
+  }
 
-  QueueSort(g_queue);
-  QueueShowOperation(argc, argv);
+  if (!SnapshotSave(g_queue, argv[1])) {
+    ShowMsg("save the queue to %s failed\n", argv[1]);
+    return false;
+  }
+  ShowMsg("the queue is saved to %s\n", argv[1]);
+
+  return true;
+}
+
+/* Replaces the queue by one loaded from snapshot file argv[1]
+ * The queue is kept if loading failed
+ * On success, return true */
+static bool QueueLoadOperation(int argc, char **argv) {
+  MsgBuf change;
+  Queue *queue = NULL;
+
+  if (argc < 2 || argv[1] == NULL) {
+    ShowMsg("load needs a file name\n");
+    return false;
+  }
+
+  queue = SnapshotLoad(argv[1]);
+  if (queue == NULL) {
+    ShowMsg("load the queue from %s failed\n", argv[1]);
+    return false;
+  }
+  if (!RegistryPut(&g_registry, RegistryCurrentName(&g_registry), queue)) {
+    ShowMsg("memory allocation failed\n");
+    QueueFree(queue);
+    return false;
+  }
+  g_queue = queue;
+  /* The snapshot file may change later, so the journal starts over from
+   * snapshots of its own */
+  CheckJournal(JournalCompact(g_journal, &g_registry));
+  MsgBufInit(&change);
+  MsgBufPrintf(&change, "load %s", argv[1]);
+  QueueShowChange(argc, argv, &change);
+
+  return true;
+}
+
+/* Sets the display mode to argv[1], "full" or "delta", or shows it if
+ * argv[1] is not given
+ * On success, return true */
+static bool DisplayOperation(int argc, char **argv) {
+  if (argc < 2 || argv[1] == NULL) {
+    ShowMsg("display mode is %s\n",
+            g_display_mode == DISPLAY_FULL ? "full" : "delta");
+    return true;
+  }
+  if (strcmp(argv[1], "full") == 0) {
+    g_display_mode = DISPLAY_FULL;
+  } else if (strcmp(argv[1], "delta") == 0) {
+    g_display_mode = DISPLAY_DELTA;
+  } else {
+    ShowMsg("unknown display mode %s\n", argv[1]);
+    return false;
+  }
 
   return true;
 }
@@ -565,15 +1212,20 @@ static bool ClientOperation(int argc, char **argv) {
  * On success, return true */
 static bool QuitOperation(int argc, char **argv) {
   g_quit = true;
+  /* Closes the journal first, so that freeing the queue is not journaled */
+  JournalClose(g_journal);
+  g_journal = NULL;
   if (g_queue) {
     QueueFreeOperation(argc, argv);
   }
+  RegistryFree(&g_registry);
+  g_queue = NULL;
+  free(g_latency);
+  g_latency = NULL;
   /* Inactivates server if it's running */
   if (g_pid != -2) {
     kill(g_pid, SIGUSR1);
   }
-  FreeCmdList(g_cmd_list);
-  g_cmd_list = NULL;
 
   return true;
 }
@@ -584,68 +1236,281 @@ static bool SleepOperation(int argc, char **argv) {
   return true;
 }
 
-/* Adds a command into command list 
- * On success, return true */
-bool AddCmd(char *cmd, char *doc, CmdFunction op) {
-  int cmd_len = 0;
-  int doc_len = 0;
-  CmdElementPtr element = g_cmd_list;
-  CmdElementPtr *last = &g_cmd_list; 
-  CmdElementPtr new_cmd_element = NULL;
+/* Runs cmd, recording its wall time if latency is tracked; time records
+ * the command it runs instead of itself
+ * Return what cmd returns */
+static bool RunCmd(const CmdElement *cmd, int argc, char **argv) {
+  uint64_t start = 0;
+  bool ret = false;
 
-  if(!cmd || !doc || !op){
-    return false;
+  if (g_latency == NULL || cmd->op == TimeOperation) {
+    return cmd->op(argc, argv);
   }
-  cmd_len = strlen(cmd);
-  doc_len = strlen(doc);
-  /* Gets the address of last element of command list */
-  while (element) {
-    last = &(element->next);
-    element = element->next;
+  start = LatencyNow(CLOCK_MONOTONIC);
+  ret = cmd->op(argc, argv);
+  /* quit frees the histograms */
+  if (g_latency) {
+    LatencyRecord(&g_latency[cmd - g_cmd_table],
+                  LatencyNow(CLOCK_MONOTONIC) - start);
   }
+  return ret;
+}
+
+/* Runs the command of argv[1] with the arguments after it and shows its
+ * wall time and the CPU time of all threads
+ * Return what the command returns */
+static bool TimeOperation(int argc, char **argv) {
+  const CmdElement *cmd = NULL;
+  bool is_ambiguous = false;
+  uint64_t wall = 0;
+  uint64_t cpu = 0;
+  bool ret = false;
 
-  new_cmd_element = malloc(sizeof(CmdElement));
-  if (!IsMemAlloc(new_cmd_element)) {
+  if (argc < 2 || argv[1] == NULL) {
+    ShowMsg("time needs a command\n");
     return false;
   }
-  memset(new_cmd_element, 0, sizeof(CmdElement));
-
-  new_cmd_element->cmd = malloc((cmd_len + 1) * sizeof(char));
-  if (!IsMemAlloc(new_cmd_element->cmd)) {
-    FreeCmdList(new_cmd_element);
+  cmd = FindCmd(argv[1], CMD_PREFIX_ALLOWED, &is_ambiguous);
+  if (cmd == NULL) {
+    ShowMsg("%s command:%s\n", is_ambiguous ? "ambiguous" : "unknown",
+            argv[1]);
     return false;
   }
-  memset(new_cmd_element->cmd, 0, (cmd_len + 1) * sizeof(char));
-  strncpy(new_cmd_element->cmd, cmd, cmd_len);
-  new_cmd_element->cmd[cmd_len] = '\0';
 
-  new_cmd_element->doc = malloc((doc_len + 1) * sizeof(char));
-  if (!IsMemAlloc(new_cmd_element->doc)) {
-    FreeCmdList(new_cmd_element);
+  wall = LatencyNow(CLOCK_MONOTONIC);
+  cpu = LatencyNow(CLOCK_PROCESS_CPUTIME_ID);
+  /* The numbers of a script command follow its arguments */
+  if (g_arg_nums) {
+    g_arg_nums++;
+  }
+  ret = RunCmd(cmd, argc - 1, argv + 1);
+  cpu = LatencyNow(CLOCK_PROCESS_CPUTIME_ID) - cpu;
+  wall = LatencyNow(CLOCK_MONOTONIC) - wall;
+  ShowMsg("%s took %" PRIu64 " ns wall, %" PRIu64 " ns cpu\n", cmd->cmd,
+          wall, cpu);
+
+  return ret;
+}
+
+/* Writes count, min, mean and percentiles of the latency of each command
+ * run so far to CSV file_name
+ * On success, return true */
+static bool ExportLatency(const char *file_name) {
+  const LatencyHist *hist = NULL;
+  FILE *file = NULL;
+  bool is_written = true;
+
+  file = fopen(file_name, "w");
+  if (file == NULL) {
     return false;
   }
-  memset(new_cmd_element->doc, 0, (doc_len + 1) * sizeof(char));
-  strncpy(new_cmd_element->doc, doc, doc_len);
-  new_cmd_element->doc[doc_len] = '\0';
+  fprintf(file, "command,count,min_ns,mean_ns,p50_ns,p90_ns,p99_ns,max_ns\n");
+  for (int i = 0; i < g_cmd_num; i++) {
+    hist = &g_latency[i];
+    if (hist->num == 0) {
+      continue;
+    }
+    fprintf(file,
+            "%s,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64
+            ",%" PRIu64 ",%" PRIu64 "\n",
+            g_cmd_table[i].cmd, hist->num, hist->min, hist->sum / hist->num,
+            LatencyPercentile(hist, 50), LatencyPercentile(hist, 90),
+            LatencyPercentile(hist, 99), hist->max);
+  }
+  is_written = !ferror(file);
+  return fclose(file) == 0 && is_written;
+}
+
+/* Shows percentiles of the latency of each command run so far, exports
+ * them to CSV file argv[i + 1] if argv[i] is "-csv", or clears them if
+ * "-reset" is given
+ * On success, return true */
+static bool LatencyOperation(int argc, char **argv) {
+  const LatencyHist *hist = NULL;
+  char *csv_file = NULL;
+  bool is_reset = false;
+  bool is_rendered = true;
+  MsgBuf buf;
+
+  if (g_latency == NULL) {
+    ShowMsg("latency is not tracked, run with -T\n");
+    return true;
+  }
+  for (int i = 1; i < argc && argv[i]; i++) {
+    if (strcmp(argv[i], "-csv") == 0 && i + 1 < argc && argv[i + 1]) {
+      csv_file = argv[++i];
+    } else if (strcmp(argv[i], "-reset") == 0) {
+      is_reset = true;
+    } else {
+      ShowMsg("unknown option %s\n", argv[i]);
+      return false;
+    }
+  }
+
+  if (csv_file) {
+    if (!ExportLatency(csv_file)) {
+      ShowMsg("export latency to %s failed\n", csv_file);
+      return false;
+    }
+    ShowMsg("latency is exported to %s\n", csv_file);
+  }
+  if (is_reset) {
+    for (int i = 0; i < g_cmd_num; i++) {
+      LatencyReset(&g_latency[i]);
+    }
+    ShowMsg("latency is cleared\n");
+  }
+  if (csv_file || is_reset) {
+    return true;
+  }
+  MsgBufInit(&buf);
+  is_rendered = MsgBufPrintf(&buf, "%-8s %10s %12s %12s %12s %12s (ns)\n",
+                             "command", "count", "p50", "p90", "p99", "max");
+  for (int i = 0; i < g_cmd_num && is_rendered; i++) {
+    hist = &g_latency[i];
+    if (hist->num == 0) {
+      continue;
+    }
+    is_rendered = MsgBufPrintf(
+        &buf, "%-8s %10" PRIu64 " %12" PRIu64 " %12" PRIu64 " %12" PRIu64
+              " %12" PRIu64 "\n",
+        g_cmd_table[i].cmd, hist->num, LatencyPercentile(hist, 50),
+        LatencyPercentile(hist, 90), LatencyPercentile(hist, 99), hist->max);
+  }
+  if (is_rendered) {
+    ShowMsgBuf(&buf);
+  } else {
+    ShowMsg("show the latency failed\n");
+  }
+  MsgBufFree(&buf);
 
-  new_cmd_element->op = op;
-  new_cmd_element->next = NULL;
-  *last = new_cmd_element;
+  return is_rendered;
+}
+
+/* Stops journaling if writing a change to the journal failed, so that
+ * the journal keeps the changes before the failure only
+ * No effect if there is no journal */
+static void CheckJournal(bool is_journaled) {
+  if (g_journal && !is_journaled) {
+    ShowMsg("write the journal failed, changes are not journaled anymore\n");
+    JournalClose(g_journal);
+    g_journal = NULL;
+  }
+}
+
+/* Syncs the journal if force is true or JOURNAL_SYNC_INTERVAL_MS passed
+ * since the last sync, and compacts it once it grew large
+ * No effect if there is no journal */
+static void CommitJournal(bool force) {
+  if (g_journal == NULL) {
+    return;
+  }
+  if (JournalIsLarge(g_journal)) {
+    CheckJournal(JournalCompact(g_journal, &g_registry));
+  } else {
+    CheckJournal(JournalSync(g_journal, force));
+  }
+}
+
+bool ConsoleTrackLatency() {
+  g_latency = calloc(g_cmd_num, sizeof(LatencyHist));
+
+  return IsMemAlloc(g_latency);
+}
+
+bool ConsoleOpenJournal(char *journal_file) {
+  int record_num = 0;
+
+  g_journal = JournalOpen(journal_file, &g_registry, &record_num);
+  g_queue = RegistryCurrent(&g_registry);
+  if (g_journal == NULL) {
+    ShowMsg("open journal %s failed\n", journal_file);
+    QuitOperation(0, NULL);
+    return false;
+  }
+  ShowMsg("%d changes are replayed from journal %s\n", record_num,
+          journal_file);
 
   return true;
 }
 
+/* Runs the instructions of the batch compiled last in script until their
+ * end or quit */
+static void RunScriptBatch(Script *script) {
+  char *argv[TOKEN_MAX_ARGS + 1];
+  ScriptInstr *instr = NULL;
+
+  for (size_t pc = 0; pc < script->num && !g_quit; pc++) {
+    instr = &script->instrs[pc];
+    switch (instr->opcode) {
+    case SCRIPT_COMMENT:
+      /* Shows the description of test case */
+      printf("%.*s\n", instr->line_len, instr->line);
+      break;
+    case SCRIPT_REPEAT:
+      instr->remaining = instr->count;
+      if (instr->remaining == 0) {
+        pc = instr->jump;
+      }
+      break;
+    case SCRIPT_END:
+      if (--script->instrs[instr->jump].remaining > 0) {
+        pc = instr->jump;
+      }
+      break;
+    default:
+      if (g_is_visible || g_log_file) {
+        ShowMsg("%.*s\n", instr->line_len, instr->line);
+      }
+      if (instr->opcode == SCRIPT_CMD) {
+        /* A command may permute its arguments, e.g., by getopt(), so it
+         * gets a copy to keep them for the next iteration */
+        memcpy(argv, script->args + instr->arg_idx,
+               (instr->argc + 1) * sizeof(char *));
+        g_arg_nums = script->nums + instr->arg_idx;
+        RunCmd(instr->cmd, instr->argc, argv);
+        g_arg_nums = NULL;
+        CommitJournal(false);
+      } else {
+        ShowMsg("%s command:%s\n",
+                instr->opcode == SCRIPT_AMBIGUOUS ? "ambiguous" : "unknown",
+                script->args[instr->arg_idx]);
+        fflush(stdout);
+      }
+    }
+  }
+}
+
+/* Compiles input_file, or stdin if it's SCRIPT_STDIN, a batch at a time
+ * and runs the instructions until the end or quit
+ * On success, return true */
+static bool RunScript(char *input_file) {
+  Script script;
+  bool is_run = false;
+
+  if (!ScriptOpen(&script, input_file)) {
+    QuitOperation(0, NULL);
+    return false;
+  }
+  while (!g_quit && ScriptCompileNext(&script)) {
+    RunScriptBatch(&script);
+  }
+  is_run = !script.is_failed;
+  QuitOperation(0, NULL);
+  ScriptClose(&script);
+
+  return is_run;
+}
+
 bool RunConsole(char *input_file, char *log_file, bool is_visible) {
+  char *argv[TOKEN_MAX_ARGS + 1];
   char *cmd = NULL;
-  char *trim_cmd = NULL;
-  char **argv = NULL;
+  char *line = NULL;
   bool ret = false;
   int argc = 0;
-  size_t cmd_line_len = 0;
-  ssize_t num_read = 0;
-  FILE *input_file_ptr = NULL;
   FILE *history_file_name_ptr = NULL;
-  CmdElementPtr cmd_list;
+  const CmdElement *cmd_element = NULL;
+  bool is_ambiguous = false;
 
   g_is_visible = is_visible;
   g_log_file = log_file;
@@ -670,92 +1535,70 @@ bool RunConsole(char *input_file, char *log_file, bool is_visible) {
     g_is_visible = is_visible;
   }
   /* Checks existence of file */
-  if (input_file && access(input_file, F_OK) == -1) {
+  if (input_file && strcmp(input_file, SCRIPT_STDIN) != 0 &&
+      access(input_file, F_OK) == -1) {
     ShowMsg("%s does not exist\n", input_file);
     QuitOperation(0, NULL);
     return false;
   }
   if (input_file) {
-    if (!(input_file_ptr = fopen(input_file, "r"))) {
-      ShowMsg("open file %s failed\n", input_file);
-      QuitOperation(0, NULL);
-      return false;
-    }
+    return RunScript(input_file);
   }
   while (!g_quit) {
     argc = 0;
     cmd = NULL;
-    trim_cmd = NULL;
-    cmd_list = g_cmd_list;
-
-    if (input_file) { /* Inputs from input file */
-      /* On success, returns the number of character read 
-       * On error or EOF, returns -1 */
-      if ((num_read = getline(&cmd, &cmd_line_len, input_file_ptr)) == -1) {
-	FreeString(1, cmd);
-	QuitOperation(0, NULL);
-	fclose(input_file_ptr);
-        if(errno == 0){ /* EOF */
-	  return true;
-	}
-        return false; /* Error */
-      }
-    } else { /* Inputs from console */
-      if((cmd = CmdLine()) == NULL){
-	FreeString(1, cmd);
-        QuitOperation(0, NULL);
-        return false;
-      }
+
+    /* Nothing is left unsynced while waiting for the user */
+    CommitJournal(true);
+    if((cmd = CmdLine()) == NULL){
+      FreeString(1, cmd);
+      QuitOperation(0, NULL);
+      return false;
     }
 
-    trim_cmd = TrimSpace(cmd);
-    FreeString(1, cmd);
-    if (*trim_cmd == '#') {
+    line = TrimLine(cmd);
+    if (*line == '#') {
       /* Shows the description of test case */
-      printf("%s\n", trim_cmd);
-      FreeString(1, trim_cmd);
+      printf("%s\n", line);
+      FreeString(1, cmd);
       continue;
-    } else if(trim_cmd == NULL || *trim_cmd == '\0') {
-      FreeString(1, trim_cmd);
+    } else if (*line == '\0') {
+      FreeString(1, cmd);
       continue;
     }
-    if(input_file){
-        ShowMsg("%s\n", trim_cmd);
-	}
-    if (!input_file) {
-      /* Adds a new command into command list */
-      if(!AddHistoryCmd(trim_cmd)) {
-        FreeString(1, trim_cmd);
-        QuitOperation(0, NULL);
-        return false;
-      }
-      /* Saves command list in g_history_file_name */
-      if(!SaveHistoryCmd(g_history_file_name)) {
-        FreeString(1, trim_cmd);
-        QuitOperation(0, NULL);
-        return false;
-      }
+    /* Adds a new command into command list */
+    if(!AddHistoryCmd(line)) {
+      FreeString(1, cmd);
+      QuitOperation(0, NULL);
+      return false;
     }
-    if((argv = SplitCmd(&argc, trim_cmd)) == NULL){
-      FreeString(1, trim_cmd);
-      continue;
+    /* Saves command list in g_history_file_name */
+    if(!SaveHistoryCmd(g_history_file_name)) {
+      FreeString(1, cmd);
+      QuitOperation(0, NULL);
+      return false;
     }
-    while (cmd_list &&strncmp(*argv, cmd_list->cmd, strlen(*argv)) != 0) {
-      cmd_list = cmd_list->next;
+    /* Splits the line in place, so argv points into cmd */
+    argc = Tokenize(line, argv, TOKEN_MAX_ARGS);
+    if (argc < 0) {
+      ShowMsg("%s\n", TokenError(argc));
+      FreeString(1, cmd);
+      continue;
     }
-    if (cmd_list) {
-      ret = cmd_list->op(argc, argv);
+    cmd_element = FindCmd(*argv, CMD_PREFIX_ALLOWED, &is_ambiguous);
+    if (cmd_element) {
+      ret = RunCmd(cmd_element, argc, argv);
+      CommitJournal(false);
+    } else if (is_ambiguous) {
+      ShowMsg("ambiguous command:%s\n", *argv);
+      fflush(stdout);
     } else {
       ShowMsg("unknown command:%s\n", *argv);
       fflush(stdout);
     }
-    free(argv);
-    FreeString(1, trim_cmd);
+    FreeString(1, cmd);
   }
   QuitOperation(0, NULL);
-  if(input_file){
-    fclose(input_file_ptr);
-  }
 
   return true;
 }
@@ -5,12 +5,22 @@
 
 typedef bool (*CmdFunction)(int, char **);
 
+#define CMD_INDEX_SIZE 512 /* Entries of the command index, a power of 2 */
+/* A command may be given as a prefix of its name shared by no other */
+#define CMD_PREFIX_ALLOWED true
+
 typedef struct CmdElement {
-  char *cmd;
-  char *doc;
+  const char *cmd;
+  const char *doc; /* Arguments, then a tab and '#' before the document */
   CmdFunction op;
-  struct CmdElement *next;
-} CmdElement, *CmdElementPtr;
+} CmdElement;
+
+/* An argument of a command parsed ahead of running it, e.g., when a
+ * script is compiled */
+typedef struct CmdNum {
+  int value;
+  bool is_num; /* The whole argument is a decimal number fitting an int */
+} CmdNum;
 
 typedef struct CmdLineState {
   /* Content of command line */
@@ -27,13 +37,31 @@ typedef struct CmdLineState {
   int history_idx;
 } CmdLineState;
 
+/* DISPLAY_FULL shows the whole queue after a command changes it,
+ * DISPLAY_DELTA shows what changed and the size */
+typedef enum DisplayMode { DISPLAY_FULL, DISPLAY_DELTA } DisplayMode;
+
 typedef struct Buffer {
   char *val;
   int len;
 } Buffer;
 
-extern CmdElementPtr g_cmd_list;
+extern const CmdElement g_cmd_table[];
+extern const int g_cmd_num;
 
 bool ConsoleInit();
+/* Return the command named name, or if is_prefix_allowed is true, the
+ * only command whose name starts with name
+ * Return NULL if there is none, setting *is_ambiguous if name is a
+ * prefix of several names */
+const CmdElement *FindCmd(const char *name, bool is_prefix_allowed,
+                          bool *is_ambiguous);
 bool RunConsole(char *input_file, char *log_file, bool is_visible);
+/* Records the latency of every command run from now on for the latency
+ * command
+ * On success, return true */
+bool ConsoleTrackLatency();
+/* Replays journal_file into the queue and journals changes to it
+ * On success, return true */
+bool ConsoleOpenJournal(char *journal_file);
 #endif
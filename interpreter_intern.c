@@ -0,0 +1,126 @@
+#include "interpreter_intern.h"
+#include <string.h>
+
+uint64_t InternHash(const char *str, size_t len) {
+  uint64_t hash = 14695981039346656037UL;
+
+  for (size_t i = 0; i < len; i++) {
+    hash ^= (unsigned char)str[i];
+    hash *= 1099511628211UL;
+  }
+  return hash;
+}
+
+void InternInit(InternTable *table, Arena *arena) {
+  if (table) {
+    memset(table, 0, sizeof(InternTable));
+    table->arena = arena;
+  }
+}
+
+/* Return the entry whose value is value */
+static InternEntry *InternEntryOf(char *value) {
+  return (InternEntry *)(value - offsetof(InternEntry, value));
+}
+
+/* Doubles the buckets and rehashes entries by their stored hashes
+ * On success, return true */
+static bool InternGrow(InternTable *table) {
+  size_t new_cap = table->cap ? table->cap * 2 : INTERN_MIN_CAP;
+  InternEntry **new_buckets = NULL;
+  size_t idx = 0;
+
+  new_buckets = ArenaAlloc(table->arena, new_cap * sizeof(InternEntry *));
+  if (new_buckets == NULL) {
+    return false;
+  }
+  memset(new_buckets, 0, new_cap * sizeof(InternEntry *));
+  for (size_t i = 0; i < table->cap; i++) {
+    if (table->buckets[i] == NULL) {
+      continue;
+    }
+    idx = table->buckets[i]->hash & (new_cap - 1);
+    while (new_buckets[idx]) {
+      idx = (idx + 1) & (new_cap - 1);
+    }
+    new_buckets[idx] = table->buckets[i];
+  }
+  ArenaFree(table->arena, table->buckets, table->cap * sizeof(InternEntry *));
+  table->buckets = new_buckets;
+  table->cap = new_cap;
+  return true;
+}
+
+char *InternAcquire(InternTable *table, const char *str, size_t len) {
+  uint64_t hash = 0;
+  size_t idx = 0;
+  InternEntry *entry = NULL;
+
+  if (table == NULL || str == NULL) {
+    return NULL;
+  }
+  /* Keeps the load factor at most 1/2 */
+  if ((table->num + 1) * 2 > table->cap && !InternGrow(table)) {
+    return NULL;
+  }
+  hash = InternHash(str, len);
+  idx = hash & (table->cap - 1);
+  while ((entry = table->buckets[idx]) != NULL) {
+    if (entry->hash == hash && entry->len == len &&
+        memcmp(entry->value, str, len) == 0) {
+      entry->ref_count++;
+      return entry->value;
+    }
+    idx = (idx + 1) & (table->cap - 1);
+  }
+  entry = ArenaAlloc(table->arena, sizeof(InternEntry) + len + 1);
+  if (entry == NULL) {
+    return NULL;
+  }
+  entry->hash = hash;
+  entry->ref_count = 1;
+  entry->len = len;
+  memcpy(entry->value, str, len);
+  entry->value[len] = '\0';
+  table->buckets[idx] = entry;
+  table->num++;
+  return entry->value;
+}
+
+void InternRelease(InternTable *table, char *value) {
+  InternEntry *entry = NULL;
+  size_t idx = 0;
+  size_t next = 0;
+  size_t home = 0;
+
+  if (table == NULL || value == NULL) {
+    return;
+  }
+  entry = InternEntryOf(value);
+  if (--entry->ref_count > 0) {
+    return;
+  }
+  idx = entry->hash & (table->cap - 1);
+  while (table->buckets[idx] != entry) {
+    idx = (idx + 1) & (table->cap - 1);
+  }
+  /* Shifts later entries of the probe run back so that lookups never
+   * stop at the hole */
+  next = idx;
+  while (true) {
+    next = (next + 1) & (table->cap - 1);
+    if (table->buckets[next] == NULL) {
+      break;
+    }
+    home = table->buckets[next]->hash & (table->cap - 1);
+    /* Moves the entry unless its home lies cyclically in (idx, next] */
+    if (idx <= next ? (home <= idx || home > next)
+                    : (home <= idx && home > next)) {
+      table->buckets[idx] = table->buckets[next];
+      idx = next;
+    }
+  }
+  table->buckets[idx] = NULL;
+  table->num--;
+  ArenaFree(table->arena, entry, sizeof(InternEntry) + entry->len + 1);
+}
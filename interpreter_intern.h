@@ -0,0 +1,45 @@
+#ifndef INTERPRETER_INTERN_H_
+#define INTERPRETER_INTERN_H_
+#include "interpreter_arena.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define INTERN_MIN_CAP 64 /* Initial number of buckets */
+
+/* A single shared copy of a string */
+typedef struct InternEntry {
+  uint64_t hash;
+  /* Number of elements sharing value */
+  unsigned int ref_count;
+  unsigned int len;
+  char value[];
+} InternEntry;
+
+/* An open addressing hash table of strings with linear probing
+ * Entries and buckets are allocated from arena */
+typedef struct InternTable {
+  InternEntry **buckets;
+  size_t cap; /* Number of buckets, a power of 2 */
+  size_t num; /* Number of distinct strings */
+  Arena *arena;
+} InternTable;
+
+/* Return FNV-1a hash of the first len characters of str */
+uint64_t InternHash(const char *str, size_t len);
+
+/* Initializes an empty table whose memory comes from arena
+ * No effect if table is NULL */
+void InternInit(InternTable *table, Arena *arena);
+
+/* Looks str of len characters up and adds it if it's missing
+ * On success, return the shared null-terminated copy of str and
+ * increases its reference count
+ * On error, return NULL */
+char *InternAcquire(InternTable *table, const char *str, size_t len);
+
+/* Decreases the reference count of value returned by InternAcquire()
+ * and frees it when no one refers to it
+ * No effect if table or value is NULL */
+void InternRelease(InternTable *table, char *value);
+#endif
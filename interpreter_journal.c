@@ -0,0 +1,600 @@
+#include "interpreter_journal.h"
+#include "interpreter_rio.h"
+#include "interpreter_snapshot.h"
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* FNV-1a hash of record but its checksum, and of payload */
+static uint32_t JournalChecksum(const JournalRecord *record,
+                                const char *payload) {
+  const unsigned char *bytes = (const unsigned char *)&record->type;
+  size_t len = sizeof(JournalRecord) - offsetof(JournalRecord, type);
+  uint32_t hash = 2166136261U;
+
+  for (size_t i = 0; i < len; i++) {
+    hash ^= bytes[i];
+    hash *= 16777619U;
+  }
+  for (size_t i = 0; i < record->size; i++) {
+    hash ^= (unsigned char)payload[i];
+    hash *= 16777619U;
+  }
+  return hash;
+}
+
+/* Return the name of snapshot idx of epoch, FILE.EPOCH.IDX.snap, or
+ * FILE.EPOCH.snap of version 1 if idx is negative, which the caller frees
+ * On error, return NULL */
+static char *JournalSnapshotName(const char *file_name, uint64_t epoch,
+                                 int idx) {
+  size_t name_size = strlen(file_name) + 48;
+  char *name = malloc(name_size);
+
+  if (name && idx < 0) {
+    snprintf(name, name_size, "%s.%" PRIu64 ".snap", file_name, epoch);
+  } else if (name) {
+    snprintf(name, name_size, "%s.%" PRIu64 ".%d.snap", file_name, epoch,
+             idx);
+  }
+  return name;
+}
+
+/* Loads snapshot idx, or the one of version 1 if idx is negative, of the
+ * epoch of journal into registry under name
+ * On success, return true */
+static bool JournalLoad(Journal *journal, int idx, const char *name,
+                        QueueRegistry *registry) {
+  struct stat snapshot_stat;
+  char *snapshot_name = NULL;
+  Queue *queue = NULL;
+
+  snapshot_name = JournalSnapshotName(journal->file_name, journal->epoch, idx);
+  if (snapshot_name) {
+    queue = SnapshotLoad(snapshot_name);
+  }
+  if (queue && stat(snapshot_name, &snapshot_stat) == 0) {
+    journal->snapshot_size += snapshot_stat.st_size;
+  }
+  free(snapshot_name);
+  if (queue == NULL || !RegistryPut(registry, name, queue)) {
+    QueueFree(queue);
+    return false;
+  }
+  if (idx >= journal->snapshot_num) {
+    journal->snapshot_num = idx + 1;
+  }
+  return true;
+}
+
+/* Return true if payload of size bytes is num null-terminated strings */
+static bool JournalIsPacked(const char *payload, uint32_t size, uint32_t num) {
+  const char *end = payload + size;
+
+  if (size == 0 || payload[size - 1] != '\0') {
+    return false;
+  }
+  while (payload < end && num > 0) {
+    payload = memchr(payload, '\0', end - payload) + 1;
+    num--;
+  }
+  return payload == end && num == 0;
+}
+
+/* Applies record with payload to the current queue of registry, or to
+ * registry itself
+ * On success, return true */
+static bool JournalApply(Journal *journal, const JournalRecord *record,
+                         const char *payload, QueueRegistry *registry) {
+  Queue *queue = RegistryCurrent(registry);
+  bool is_applied = true;
+
+  if (record->type < JOURNAL_USE && record->type != JOURNAL_NEW &&
+      record->type != JOURNAL_FREE && queue == NULL) {
+    return false;
+  }
+  switch (record->type) {
+  case JOURNAL_NEW:
+    /* A version 1 record creates the queue under the current name */
+    if (record->size > 0 && (!JournalIsPacked(payload, record->size, 1) ||
+                             !RegistryUse(registry, payload))) {
+      return false;
+    }
+    queue = QueueNewKind(SnapshotKind(record->arg));
+    if (queue == NULL) {
+      return false;
+    }
+    if (record->arg & SNAPSHOT_INTERNED) {
+      QueueEnableIntern(queue);
+    }
+    if (!RegistryPut(registry, RegistryCurrentName(registry), queue)) {
+      QueueFree(queue);
+      return false;
+    }
+    break;
+  case JOURNAL_FREE:
+    QueueFree(RegistryTake(registry, RegistryCurrentName(registry)));
+    break;
+  case JOURNAL_INSERT_HEAD:
+  case JOURNAL_INSERT_TAIL:
+    if (!JournalIsPacked(payload, record->size, record->arg)) {
+      return false;
+    }
+    for (uint32_t i = 0; i < record->repeat && is_applied; i++) {
+      if (record->type == JOURNAL_INSERT_HEAD) {
+        is_applied = QueueInsertHeadBatch(queue, payload, record->arg);
+      } else {
+        is_applied = QueueInsertTailBatch(queue, payload, record->arg);
+      }
+    }
+    break;
+  case JOURNAL_REMOVE_HEAD:
+    is_applied = QueueRemoveHead(queue);
+    break;
+  case JOURNAL_REVERSE:
+    QueueReverse(queue);
+    break;
+  case JOURNAL_SORT:
+    is_applied = QueueSortMode(queue, SORT_MERGE);
+    break;
+  case JOURNAL_DEDUP:
+    is_applied = QueueDedup(queue, NULL);
+    break;
+  case JOURNAL_SET:
+    is_applied = JournalIsPacked(payload, record->size, 1) &&
+                 QueueSet(queue, record->arg, payload);
+    break;
+  case JOURNAL_DELETE:
+    is_applied = QueueDelete(queue, record->arg);
+    break;
+  case JOURNAL_USE:
+    is_applied = JournalIsPacked(payload, record->size, 1) &&
+                 RegistryUse(registry, payload);
+    break;
+  case JOURNAL_DROP:
+    is_applied = JournalIsPacked(payload, record->size, 1);
+    if (is_applied) {
+      QueueFree(RegistryTake(registry, payload));
+    }
+    break;
+  case JOURNAL_CONCAT:
+    is_applied = JournalIsPacked(payload, record->size, 2) &&
+                 QueueConcat(RegistryGet(registry, payload),
+                             RegistryGet(registry,
+                                         payload + strlen(payload) + 1));
+    break;
+  case JOURNAL_LOAD:
+    is_applied = JournalIsPacked(payload, record->size, 1) &&
+                 JournalLoad(journal, record->arg, payload, registry);
+    break;
+  default:
+    is_applied = false;
+  }
+  return is_applied;
+}
+
+/* Replays the snapshots and records of the journal file fd of file_size
+ * bytes into registry
+ * Replay stops at the first torn or corrupt record
+ * On success, return bytes of the valid part of the journal
+ * On error, return -1 */
+static off_t JournalReplay(Journal *journal, off_t file_size,
+                           QueueRegistry *registry, int *record_num) {
+  JournalHeader header;
+  JournalRecord record;
+  char *mapping = NULL;
+  off_t offset = sizeof(JournalHeader);
+
+  if (file_size < (off_t)sizeof(JournalHeader)) {
+    return -1;
+  }
+  mapping = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, journal->fd, 0);
+  if (mapping == MAP_FAILED) {
+    return -1;
+  }
+  madvise(mapping, file_size, MADV_SEQUENTIAL);
+  memcpy(&header, mapping, sizeof(header));
+  if (memcmp(header.magic, JOURNAL_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version < 1 || header.version > JOURNAL_VERSION) {
+    munmap(mapping, file_size);
+    return -1;
+  }
+  journal->epoch = header.epoch;
+  RegistryFree(registry);
+  if (header.version == 1 && (header.flags & JOURNAL_HAS_SNAPSHOT) &&
+      !JournalLoad(journal, -1, RegistryCurrentName(registry), registry)) {
+    munmap(mapping, file_size);
+    return -1;
+  }
+  while (file_size - offset >= (off_t)sizeof(JournalRecord)) {
+    memcpy(&record, mapping + offset, sizeof(record));
+    if (record.size > file_size - offset - sizeof(JournalRecord) ||
+        record.checksum !=
+            JournalChecksum(&record, mapping + offset + sizeof(record))) {
+      break; /* Torn by a crash while it was written */
+    }
+    if (!JournalApply(journal, &record, mapping + offset + sizeof(record),
+                      registry)) {
+      munmap(mapping, file_size);
+      return -1;
+    }
+    offset += sizeof(JournalRecord) + record.size;
+    (*record_num)++;
+  }
+  munmap(mapping, file_size);
+  return offset;
+}
+
+/* Writes a header of epoch to fd
+ * On success, return true */
+static bool JournalWriteHeader(int fd, uint64_t epoch) {
+  JournalHeader header;
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, JOURNAL_MAGIC, sizeof(header.magic));
+  header.version = JOURNAL_VERSION;
+  header.epoch = epoch;
+  return WriteNum(fd, &header, sizeof(header)) >= 0;
+}
+
+Journal *JournalOpen(const char *file_name, QueueRegistry *registry,
+                     int *record_num) {
+  Journal *journal = NULL;
+  struct stat file_stat;
+  off_t valid_size = 0;
+
+  if (file_name == NULL || registry == NULL || record_num == NULL) {
+    return NULL;
+  }
+  *record_num = 0;
+  journal = calloc(1, sizeof(Journal));
+  if (journal == NULL) {
+    return NULL;
+  }
+  journal->file_name = strdup(file_name);
+  journal->buf = malloc(JOURNAL_BUF_SIZE);
+  journal->fd = open(file_name, O_RDWR | O_CREAT | O_APPEND, 0600);
+  if (journal->file_name == NULL || journal->buf == NULL ||
+      journal->fd < 0 || fstat(journal->fd, &file_stat) < 0) {
+    goto fail;
+  }
+  if (file_stat.st_size == 0) {
+    if (!JournalWriteHeader(journal->fd, 0) || fsync(journal->fd) < 0 ||
+        SyncDir(file_name) < 0) {
+      goto fail;
+    }
+    valid_size = sizeof(JournalHeader);
+  } else {
+    valid_size =
+        JournalReplay(journal, file_stat.st_size, registry, record_num);
+    if (valid_size < 0) {
+      goto fail;
+    }
+    if (valid_size < file_stat.st_size &&
+        ftruncate(journal->fd, valid_size) < 0) {
+      goto fail;
+    }
+  }
+  journal->size = valid_size;
+  clock_gettime(CLOCK_MONOTONIC, &journal->last_sync);
+  return journal;
+
+fail:
+  if (journal->fd >= 0) {
+    close(journal->fd);
+  }
+  free(journal->file_name);
+  free(journal->buf);
+  free(journal);
+  return NULL;
+}
+
+/* Writes buffered records to the journal file
+ * On success, return true */
+static bool JournalFlush(Journal *journal) {
+  if (journal->buf_len == 0) {
+    return true;
+  }
+  if (WriteNum(journal->fd, journal->buf, journal->buf_len) < 0) {
+    return false;
+  }
+  journal->buf_len = 0;
+  journal->is_dirty = true;
+  return true;
+}
+
+/* Buffers record and its payload, writing them at once if they are
+ * bigger than the buffer
+ * On success, return true */
+static bool JournalWrite(Journal *journal, JournalRecord *record,
+                         const char *payload) {
+  size_t total = sizeof(JournalRecord) + record->size;
+
+  record->checksum = JournalChecksum(record, payload);
+  if (journal->buf_len + total > JOURNAL_BUF_SIZE && !JournalFlush(journal)) {
+    return false;
+  }
+  if (total > JOURNAL_BUF_SIZE) {
+    if (WriteNum(journal->fd, record, sizeof(JournalRecord)) < 0 ||
+        WriteNum(journal->fd, (void *)payload, record->size) < 0) {
+      return false;
+    }
+    journal->is_dirty = true;
+  } else {
+    memcpy(journal->buf + journal->buf_len, record, sizeof(JournalRecord));
+    if (record->size > 0) {
+      memcpy(journal->buf + journal->buf_len + sizeof(JournalRecord), payload,
+             record->size);
+    }
+    journal->buf_len += total;
+  }
+  journal->size += total;
+  return true;
+}
+
+bool JournalNew(Journal *journal, uint32_t flags, const char *name) {
+  JournalRecord record;
+
+  if (journal == NULL || name == NULL) {
+    return false;
+  }
+  memset(&record, 0, sizeof(record));
+  record.type = JOURNAL_NEW;
+  record.arg = flags;
+  record.size = strlen(name) + 1;
+  return JournalWrite(journal, &record, name);
+}
+
+bool JournalNames(Journal *journal, JournalType type, const char *name,
+                  const char *other) {
+  JournalRecord record;
+  size_t name_size = 0;
+  size_t other_size = 0;
+  char *payload = NULL;
+  bool is_written = false;
+
+  if (journal == NULL || name == NULL) {
+    return false;
+  }
+  name_size = strlen(name) + 1;
+  other_size = other ? strlen(other) + 1 : 0;
+  payload = malloc(name_size + other_size);
+  if (payload == NULL) {
+    return false;
+  }
+  memcpy(payload, name, name_size);
+  if (other) {
+    memcpy(payload + name_size, other, other_size);
+  }
+  memset(&record, 0, sizeof(record));
+  record.type = type;
+  record.size = name_size + other_size;
+  is_written = JournalWrite(journal, &record, payload);
+  free(payload);
+  return is_written;
+}
+
+bool JournalInsert(Journal *journal, bool at_head, const char *strs, int num,
+                   int repeat) {
+  JournalRecord record;
+  const char *str = strs;
+
+  if (journal == NULL || strs == NULL || num < 1 || repeat < 1) {
+    return false;
+  }
+  for (int i = 0; i < num; i++) {
+    str += strlen(str) + 1;
+  }
+  memset(&record, 0, sizeof(record));
+  record.type = at_head ? JOURNAL_INSERT_HEAD : JOURNAL_INSERT_TAIL;
+  record.arg = num;
+  record.repeat = repeat;
+  record.size = str - strs;
+  return JournalWrite(journal, &record, strs);
+}
+
+bool JournalSet(Journal *journal, int idx, const char *str) {
+  JournalRecord record;
+
+  if (journal == NULL || str == NULL || idx < 0) {
+    return false;
+  }
+  memset(&record, 0, sizeof(record));
+  record.type = JOURNAL_SET;
+  record.arg = idx;
+  record.size = strlen(str) + 1;
+  return JournalWrite(journal, &record, str);
+}
+
+bool JournalDelete(Journal *journal, int idx) {
+  JournalRecord record;
+
+  if (journal == NULL || idx < 0) {
+    return false;
+  }
+  memset(&record, 0, sizeof(record));
+  record.type = JOURNAL_DELETE;
+  record.arg = idx;
+  return JournalWrite(journal, &record, NULL);
+}
+
+bool JournalAppend(Journal *journal, JournalType type) {
+  JournalRecord record;
+
+  if (journal == NULL) {
+    return false;
+  }
+  memset(&record, 0, sizeof(record));
+  record.type = type;
+  return JournalWrite(journal, &record, NULL);
+}
+
+bool JournalSync(Journal *journal, bool force) {
+  struct timespec now;
+  long elapsed_ms = 0;
+
+  if (journal == NULL) {
+    return false;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  elapsed_ms = (now.tv_sec - journal->last_sync.tv_sec) * 1000 +
+               (now.tv_nsec - journal->last_sync.tv_nsec) / 1000000;
+  /* Records appended within the interval wait to be synced together */
+  if (!force && elapsed_ms < JOURNAL_SYNC_INTERVAL_MS) {
+    return true;
+  }
+  if (!JournalFlush(journal)) {
+    return false;
+  }
+  if (journal->is_dirty && fdatasync(journal->fd) < 0) {
+    return false;
+  }
+  journal->is_dirty = false;
+  journal->last_sync = now;
+  return true;
+}
+
+bool JournalIsLarge(Journal *journal) {
+  if (journal == NULL) {
+    return false;
+  }
+  return journal->size > JOURNAL_COMPACT_MIN_SIZE &&
+         journal->size > journal->snapshot_size;
+}
+
+/* Writes record of type with arg and the name as its payload to fd
+ * Return the number of bytes written
+ * On error, return -1 */
+static off_t JournalWriteName(int fd, JournalType type, int arg,
+                              const char *name) {
+  JournalRecord record;
+
+  memset(&record, 0, sizeof(record));
+  record.type = type;
+  record.arg = arg;
+  record.size = strlen(name) + 1;
+  record.checksum = JournalChecksum(&record, name);
+  if (WriteNum(fd, &record, sizeof(record)) < 0 ||
+      WriteNum(fd, (void *)name, record.size) < 0) {
+    return -1;
+  }
+  return sizeof(record) + record.size;
+}
+
+/* Unlinks snapshots 0 to num - 1 of epoch and the one of version 1 */
+static void JournalUnlinkSnapshots(const char *file_name, uint64_t epoch,
+                                   int num) {
+  char *snapshot_name = NULL;
+
+  for (int i = -1; i < num; i++) {
+    snapshot_name = JournalSnapshotName(file_name, epoch, i);
+    if (snapshot_name) {
+      unlink(snapshot_name);
+      free(snapshot_name);
+    }
+  }
+}
+
+bool JournalCompact(Journal *journal, QueueRegistry *registry) {
+  struct stat snapshot_stat;
+  RegistryEntry *list = NULL;
+  char *snapshot_name = NULL;
+  char *tmp_name = NULL;
+  size_t tmp_name_size = 0;
+  uint64_t epoch = 0;
+  off_t size = sizeof(JournalHeader);
+  off_t snapshot_size = 0;
+  off_t written = 0;
+  int num = 0;
+  int fd = -1;
+  bool is_compacted = false;
+
+  if (journal == NULL || registry == NULL || !JournalSync(journal, true)) {
+    return false;
+  }
+  list = RegistryList(registry);
+  if (registry->num > 0 && list == NULL) {
+    return false;
+  }
+  epoch = journal->epoch + 1;
+  tmp_name_size = strlen(journal->file_name) + 5;
+  tmp_name = malloc(tmp_name_size);
+  if (tmp_name == NULL) {
+    goto out;
+  }
+  snprintf(tmp_name, tmp_name_size, "%s.tmp", journal->file_name);
+  fd = open(tmp_name, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0600);
+  if (fd < 0 || !JournalWriteHeader(fd, epoch)) {
+    goto fail;
+  }
+  for (; num < (int)registry->num; num++) {
+    snapshot_name = JournalSnapshotName(journal->file_name, epoch, num);
+    if (snapshot_name == NULL ||
+        !SnapshotSave(list[num].queue, snapshot_name) ||
+        stat(snapshot_name, &snapshot_stat) < 0) {
+      /* The partial snapshot is unlinked below */
+      num += snapshot_name != NULL;
+      free(snapshot_name);
+      goto fail;
+    }
+    free(snapshot_name);
+    snapshot_size += snapshot_stat.st_size;
+    written = JournalWriteName(fd, JOURNAL_LOAD, num, list[num].name);
+    if (written < 0) {
+      num++;
+      goto fail;
+    }
+    size += written;
+  }
+  written = JournalWriteName(fd, JOURNAL_USE, 0,
+                             RegistryCurrentName(registry));
+  /* Renaming the journal of the new epoch over the old one is the point
+   * where the snapshots take over from the old records */
+  if (written < 0 || fsync(fd) < 0 ||
+      rename(tmp_name, journal->file_name) < 0) {
+    goto fail;
+  }
+  close(journal->fd);
+  journal->fd = fd;
+  /* The old snapshots go only once the rename is on disk, or a crash
+   * could bring the old journal back without the snapshots it loads;
+   * they are left behind if it's unknown */
+  if (SyncDir(journal->file_name) == 0) {
+    JournalUnlinkSnapshots(journal->file_name, journal->epoch,
+                           journal->snapshot_num);
+  }
+  journal->epoch = epoch;
+  journal->size = size + written;
+  journal->snapshot_size = snapshot_size;
+  journal->snapshot_num = num;
+  is_compacted = true;
+  goto out;
+
+fail:
+  if (fd >= 0) {
+    close(fd);
+    unlink(tmp_name);
+  }
+  JournalUnlinkSnapshots(journal->file_name, epoch, num);
+out:
+  free(list);
+  free(tmp_name);
+  return is_compacted;
+}
+
+void JournalClose(Journal *journal) {
+  if (journal == NULL) {
+    return;
+  }
+  JournalSync(journal, true);
+  close(journal->fd);
+  free(journal->file_name);
+  free(journal->buf);
+  free(journal);
+}
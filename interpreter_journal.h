@@ -0,0 +1,136 @@
+#ifndef INTERPRETER_JOURNAL_H_
+#define INTERPRETER_JOURNAL_H_
+#include "interpreter_queue.h"
+#include "interpreter_registry.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
+
+#define JOURNAL_MAGIC "IQJRNL01"
+#define JOURNAL_VERSION 2
+/* Records of a version 1 journal apply to the epoch's snapshot */
+#define JOURNAL_HAS_SNAPSHOT 0x1
+#define JOURNAL_BUF_SIZE (1024 * 1024) /* Bytes of records buffered */
+/* A commit syncs records at most this often, the ones appended in
+ * between are synced together */
+#define JOURNAL_SYNC_INTERVAL_MS 10
+/* The journal is compacted into a snapshot when it grows beyond this
+ * and beyond the size of the last snapshot */
+#define JOURNAL_COMPACT_MIN_SIZE (16 * 1024 * 1024)
+
+/* A journal file is laid out as
+ *   JournalHeader
+ *   JournalRecord followed by size bytes of payload, repeatedly
+ * Records apply to the current queue of a registry, which JOURNAL_NEW and
+ * JOURNAL_USE switch; a compacted journal starts with JOURNAL_LOAD
+ * records of its snapshots FILE.EPOCH.IDX.snap
+ * Records of version 1 apply to the snapshot FILE.EPOCH.snap if
+ * JOURNAL_HAS_SNAPSHOT is set, otherwise to no queue */
+typedef struct JournalHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t flags;
+  uint64_t epoch;
+} JournalHeader;
+
+typedef enum JournalType {
+  JOURNAL_NEW = 1,     /* arg is SnapshotFlags() of the queue, payload is
+                        * its name unless it's version 1 */
+  JOURNAL_FREE,
+  JOURNAL_INSERT_HEAD, /* Payload is arg strings, each inserted repeat times */
+  JOURNAL_INSERT_TAIL,
+  JOURNAL_REMOVE_HEAD,
+  JOURNAL_REVERSE,
+  JOURNAL_SORT,
+  JOURNAL_DEDUP,
+  JOURNAL_SET,         /* arg is the position, payload is the new string */
+  JOURNAL_DELETE,      /* arg is the position */
+  JOURNAL_USE,         /* Payload is the name made current */
+  JOURNAL_DROP,        /* Payload is the name of the dropped queue */
+  JOURNAL_CONCAT,      /* Payload is the names of the queues to concat */
+  JOURNAL_LOAD         /* arg is IDX of the snapshot, payload is its name */
+} JournalType;
+
+typedef struct JournalRecord {
+  uint32_t checksum; /* FNV-1a of the rest of the record and the payload */
+  uint32_t type;
+  uint32_t arg;
+  uint32_t repeat;
+  uint32_t size;     /* Bytes of payload */
+} JournalRecord;
+
+typedef struct Journal {
+  int fd;
+  char *file_name;
+  uint64_t epoch;
+  /* Bytes of the journal, buffered records included */
+  off_t size;
+  /* Bytes and number of the snapshots written by the last compaction */
+  off_t snapshot_size;
+  int snapshot_num;
+  char *buf;
+  size_t buf_len;
+  /* Records were written since the last sync if it's true */
+  bool is_dirty;
+  struct timespec last_sync;
+} Journal;
+
+/* Opens journal file_name, creating it if it does not exist, and
+ * replays its snapshots and records into registry, counting the records
+ * in *record_num
+ * A torn record at the end, left by a crash, is cut off
+ * On success, return a pointer to a journal
+ * On error, return NULL */
+Journal *JournalOpen(const char *file_name, QueueRegistry *registry,
+                     int *record_num);
+
+/* Appends a record of a queue created with flags from SnapshotFlags()
+ * under name, which becomes current
+ * On success, return true */
+bool JournalNew(Journal *journal, uint32_t flags, const char *name);
+
+/* Appends a record of type whose payload is name, followed by other if
+ * it's not NULL, e.g., JOURNAL_CONCAT
+ * On success, return true */
+bool JournalNames(Journal *journal, JournalType type, const char *name,
+                  const char *other);
+
+/* Appends a record of num packed null-terminated strings strs, each
+ * inserted repeat times at head of the queue if at_head is true,
+ * otherwise at tail
+ * On success, return true */
+bool JournalInsert(Journal *journal, bool at_head, const char *strs, int num,
+                   int repeat);
+
+/* Appends a record of the string at position idx replaced by str
+ * On success, return true */
+bool JournalSet(Journal *journal, int idx, const char *str);
+
+/* Appends a record of the element at position idx deleted
+ * On success, return true */
+bool JournalDelete(Journal *journal, int idx);
+
+/* Appends a record of type without payload, e.g., JOURNAL_REMOVE_HEAD
+ * On success, return true */
+bool JournalAppend(Journal *journal, JournalType type);
+
+/* Writes buffered records and syncs them to disk if force is true or
+ * JOURNAL_SYNC_INTERVAL_MS passed since the last sync
+ * On success, return true */
+bool JournalSync(Journal *journal, bool force);
+
+/* Return true if the journal outgrew JOURNAL_COMPACT_MIN_SIZE and its
+ * last snapshot */
+bool JournalIsLarge(Journal *journal);
+
+/* Replaces the journal by snapshots of the queues of registry and a
+ * journal of the next epoch which loads them
+ * The old journal is kept if it failed
+ * On success, return true */
+bool JournalCompact(Journal *journal, QueueRegistry *registry);
+
+/* Syncs and closes journal
+ * No effect if journal is NULL */
+void JournalClose(Journal *journal);
+#endif
@@ -0,0 +1,88 @@
+#include "interpreter_latency.h"
+#include <string.h>
+
+uint64_t LatencyNow(clockid_t clock) {
+  struct timespec ts;
+
+  clock_gettime(clock, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void LatencyReset(LatencyHist *hist) {
+  if (hist) {
+    memset(hist, 0, sizeof(LatencyHist));
+  }
+}
+
+/* Return the bucket of ns */
+static int LatencyBucket(uint64_t ns) {
+  int exp = 0;
+
+  if (ns < LATENCY_SUB_NUM) {
+    return ns;
+  }
+  exp = 63 - __builtin_clzll(ns);
+  /* ns >> (exp - LATENCY_SUB_BITS) keeps the top LATENCY_SUB_BITS + 1
+   * bits, whose leading 1 is dropped to pick the bucket within exp */
+  return LATENCY_SUB_NUM + (exp - LATENCY_SUB_BITS) * LATENCY_SUB_NUM +
+         (int)((ns >> (exp - LATENCY_SUB_BITS)) - LATENCY_SUB_NUM);
+}
+
+/* Return the largest latency of bucket */
+static uint64_t LatencyBucketEnd(int bucket) {
+  int shift = 0;
+  uint64_t sub = 0;
+
+  if (bucket < LATENCY_SUB_NUM) {
+    return bucket;
+  }
+  shift = (bucket - LATENCY_SUB_NUM) / LATENCY_SUB_NUM;
+  sub = (bucket - LATENCY_SUB_NUM) % LATENCY_SUB_NUM;
+  return ((LATENCY_SUB_NUM + sub) << shift) + ((uint64_t)1 << shift) - 1;
+}
+
+void LatencyRecord(LatencyHist *hist, uint64_t ns) {
+  if (hist == NULL) {
+    return;
+  }
+  hist->counts[LatencyBucket(ns)]++;
+  if (hist->num == 0 || ns < hist->min) {
+    hist->min = ns;
+  }
+  if (ns > hist->max) {
+    hist->max = ns;
+  }
+  hist->num++;
+  hist->sum += ns;
+}
+
+uint64_t LatencyPercentile(const LatencyHist *hist, double percent) {
+  double exact_rank = 0;
+  uint64_t rank = 0;
+  uint64_t seen = 0;
+  uint64_t end = 0;
+
+  if (hist == NULL || hist->num == 0) {
+    return 0;
+  }
+  /* The nearest rank, counted from 1, of the percentile among the
+   * recorded latencies */
+  exact_rank = percent / 100 * hist->num;
+  rank = (uint64_t)exact_rank;
+  if (rank < exact_rank) {
+    rank++;
+  }
+  if (rank < 1) {
+    rank = 1;
+  } else if (rank > hist->num) {
+    rank = hist->num;
+  }
+  for (int i = 0; i < LATENCY_BUCKET_NUM; i++) {
+    seen += hist->counts[i];
+    if (seen >= rank) {
+      end = LatencyBucketEnd(i);
+      return end < hist->max ? end : hist->max;
+    }
+  }
+  return hist->max;
+}
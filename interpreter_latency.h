@@ -0,0 +1,40 @@
+#ifndef INTERPRETER_LATENCY_H_
+#define INTERPRETER_LATENCY_H_
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+/* Each power of 2 of nanoseconds is split into 2^LATENCY_SUB_BITS
+ * buckets, so a recorded latency is off by less than 1/32 of it */
+#define LATENCY_SUB_BITS 5
+#define LATENCY_SUB_NUM (1 << LATENCY_SUB_BITS)
+#define LATENCY_BUCKET_NUM ((64 - LATENCY_SUB_BITS + 1) * LATENCY_SUB_NUM)
+
+/* A log-linear histogram of latencies in nanoseconds, as HdrHistogram
+ * keeps them: values below LATENCY_SUB_NUM get a bucket each and larger
+ * ones share buckets as wide as 1/LATENCY_SUB_NUM of their power of 2 */
+typedef struct LatencyHist {
+  uint64_t counts[LATENCY_BUCKET_NUM];
+  uint64_t num;
+  uint64_t sum;
+  uint64_t min;
+  uint64_t max;
+} LatencyHist;
+
+/* Return nanoseconds of clock, e.g., CLOCK_MONOTONIC for wall time or
+ * CLOCK_PROCESS_CPUTIME_ID for CPU time of all threads */
+uint64_t LatencyNow(clockid_t clock);
+
+/* Empties hist
+ * No effect if hist is NULL */
+void LatencyReset(LatencyHist *hist);
+
+/* Records a latency of ns nanoseconds into hist
+ * No effect if hist is NULL */
+void LatencyRecord(LatencyHist *hist, uint64_t ns);
+
+/* Return the latency that percentile percent of the recorded ones do not
+ * exceed, rounded up to the end of its bucket but never above the max
+ * Return 0 if hist is NULL or empty */
+uint64_t LatencyPercentile(const LatencyHist *hist, double percent);
+#endif
@@ -25,19 +25,3 @@ void FreeString(size_t free_num, char *str, ...){
   }
   va_end(args);
 }
-
-void FreeCmdList(CmdElementPtr cmd_head){
-  CmdElementPtr cmd_next = cmd_head;
-
-  while(cmd_next){
-    if(cmd_next->cmd){
-      free(cmd_next->cmd);
-    }
-    if(cmd_next->doc){
-      free(cmd_next->doc);
-    }
-    cmd_next = cmd_next->next;
-    free(cmd_head);
-    cmd_head = cmd_next;
-  }
-}
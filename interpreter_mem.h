@@ -9,5 +9,4 @@
 /* Return true If memory is allocated successfully */
 bool IsMemAlloc(void *ptr);
 void FreeString(size_t free_num, char *str, ...);
-void FreeCmdList(CmdElementPtr head);
 #endif
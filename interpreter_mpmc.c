@@ -0,0 +1,253 @@
+#include "interpreter_mpmc.h"
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void Lock(MpmcQueue *queue) {
+  while (atomic_flag_test_and_set_explicit(&queue->lock,
+                                           memory_order_acquire)) {
+    sched_yield();
+  }
+}
+
+static void Unlock(MpmcQueue *queue) {
+  atomic_flag_clear_explicit(&queue->lock, memory_order_release);
+}
+
+/* Readies segment to hold the positions from base
+ * Cell i is first free for the producer at position base + i; base is
+ * published last, so a thread that sees it also sees the cells */
+static void SegmentReset(MpmcSegment *segment, size_t base) {
+  for (size_t i = 0; i < MPMC_SEGMENT_SIZE; i++) {
+    atomic_store_explicit(&segment->cells[i].sequence, base + i,
+                          memory_order_relaxed);
+  }
+  atomic_store_explicit(&segment->consumed, 0, memory_order_relaxed);
+  atomic_store_explicit(&segment->next, NULL, memory_order_relaxed);
+  atomic_store_explicit(&segment->base, base, memory_order_release);
+}
+
+/* Moves the drained segments at head to the free list
+ * Must hold lock; the tail segment is never moved, since producers
+ * still link the next one after it */
+static void SegmentReclaim(MpmcQueue *queue) {
+  MpmcSegment *segment = NULL;
+  MpmcSegment *tail = NULL;
+
+  segment = atomic_load_explicit(&queue->head_segment, memory_order_relaxed);
+  tail = atomic_load_explicit(&queue->tail_segment, memory_order_relaxed);
+  while (segment != tail &&
+         atomic_load_explicit(&segment->consumed, memory_order_acquire) ==
+             MPMC_SEGMENT_SIZE) {
+    atomic_store_explicit(&queue->head_segment,
+                          atomic_load_explicit(&segment->next,
+                                               memory_order_relaxed),
+                          memory_order_release);
+    atomic_store_explicit(&segment->next, queue->free_segment,
+                          memory_order_relaxed);
+    queue->free_segment = segment;
+    segment = atomic_load_explicit(&queue->head_segment,
+                                   memory_order_relaxed);
+  }
+}
+
+/* Links a segment after full, unless another producer already did
+ * Return false if a new segment cannot be allocated */
+static bool SegmentGrow(MpmcQueue *queue, MpmcSegment *full) {
+  MpmcSegment *segment = NULL;
+
+  Lock(queue);
+  if (atomic_load_explicit(&queue->tail_segment, memory_order_relaxed) !=
+      full) {
+    Unlock(queue);
+    return true;
+  }
+  SegmentReclaim(queue);
+  segment = queue->free_segment;
+  if (segment) {
+    queue->free_segment =
+        atomic_load_explicit(&segment->next, memory_order_relaxed);
+  } else {
+    segment = malloc(sizeof(MpmcSegment));
+    if (segment == NULL) {
+      Unlock(queue);
+      return false;
+    }
+    memset(segment, 0, sizeof(MpmcSegment));
+  }
+  SegmentReset(segment, atomic_load_explicit(&full->base,
+                                             memory_order_relaxed) +
+                            MPMC_SEGMENT_SIZE);
+  atomic_store_explicit(&full->next, segment, memory_order_release);
+  atomic_store_explicit(&queue->tail_segment, segment, memory_order_release);
+  Unlock(queue);
+  return true;
+}
+
+MpmcQueue *MpmcQueueNew() {
+  MpmcQueue *queue = NULL;
+  MpmcSegment *segment = NULL;
+
+  queue = aligned_alloc(MPMC_CACHE_LINE, sizeof(MpmcQueue));
+  if (queue == NULL) {
+    return NULL;
+  }
+  memset(queue, 0, sizeof(MpmcQueue));
+  segment = malloc(sizeof(MpmcSegment));
+  if (segment == NULL) {
+    free(queue);
+    return NULL;
+  }
+  memset(segment, 0, sizeof(MpmcSegment));
+  SegmentReset(segment, 0);
+  atomic_init(&queue->head_segment, segment);
+  atomic_init(&queue->tail_segment, segment);
+  queue->free_segment = NULL;
+  atomic_flag_clear(&queue->lock);
+  atomic_init(&queue->tail, 0);
+  atomic_init(&queue->head, 0);
+  return queue;
+}
+
+void MpmcQueueFree(MpmcQueue *queue) {
+  MpmcSegment *segment = NULL;
+  MpmcSegment *next = NULL;
+
+  if (queue == NULL) {
+    return;
+  }
+  segment = atomic_load(&queue->head_segment);
+  while (segment) {
+    next = atomic_load(&segment->next);
+    free(segment);
+    segment = next;
+  }
+  for (segment = queue->free_segment; segment; segment = next) {
+    next = atomic_load(&segment->next);
+    free(segment);
+  }
+  free(queue);
+}
+
+bool MpmcQueueInsertTail(MpmcQueue *queue, const char *str) {
+  MpmcSegment *segment = NULL;
+  MpmcCell *cell = NULL;
+  size_t pos = 0;
+  size_t base = 0;
+  size_t sequence = 0;
+
+  if (queue == NULL || str == NULL) {
+    return false;
+  }
+  pos = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+  while (true) {
+    segment = atomic_load_explicit(&queue->tail_segment,
+                                   memory_order_acquire);
+    base = atomic_load_explicit(&segment->base, memory_order_acquire);
+    if (pos - base < MPMC_SEGMENT_SIZE) {
+      cell = &segment->cells[pos - base];
+      sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+      /* The cell is free for pos, claims it by moving tail; on failure
+       * pos is reloaded with the new tail */
+      if (sequence == pos &&
+          atomic_compare_exchange_weak_explicit(&queue->tail, &pos, pos + 1,
+                                                memory_order_relaxed,
+                                                memory_order_relaxed)) {
+        break;
+      }
+      if (sequence != pos) {
+        pos = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+      }
+    } else if (pos == base + MPMC_SEGMENT_SIZE) {
+      /* The segment is full, links the next one */
+      if (!SegmentGrow(queue, segment)) {
+        return false;
+      }
+    } else {
+      /* pos is stale */
+      pos = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    }
+  }
+  cell->value = str;
+  /* Publishes the value to the consumer at pos */
+  atomic_store_explicit(&cell->sequence, pos + 1, memory_order_release);
+  return true;
+}
+
+bool MpmcQueueRemoveHead(MpmcQueue *queue, const char **value) {
+  MpmcSegment *segment = NULL;
+  MpmcSegment *next = NULL;
+  MpmcCell *cell = NULL;
+  size_t pos = 0;
+  size_t base = 0;
+  size_t sequence = 0;
+
+  if (queue == NULL) {
+    return false;
+  }
+  pos = atomic_load_explicit(&queue->head, memory_order_relaxed);
+  segment = atomic_load_explicit(&queue->head_segment, memory_order_acquire);
+  while (true) {
+    base = atomic_load_explicit(&segment->base, memory_order_acquire);
+    if (pos - base < MPMC_SEGMENT_SIZE) {
+      cell = &segment->cells[pos - base];
+      sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+      if (sequence == pos + 1) {
+        /* The cell holds the value for pos, claims it by moving head */
+        if (atomic_compare_exchange_weak_explicit(&queue->head, &pos,
+                                                  pos + 1,
+                                                  memory_order_relaxed,
+                                                  memory_order_relaxed)) {
+          break;
+        }
+        continue;
+      }
+      if (sequence == pos) {
+        /* No producer has filled the cell yet, the queue is empty */
+        return false;
+      }
+    } else if (pos >= base + MPMC_SEGMENT_SIZE) {
+      /* The head segment is drained up to pos, walks to the segment
+       * after it if that one holds the next positions */
+      next = atomic_load_explicit(&segment->next, memory_order_acquire);
+      if (next && atomic_load_explicit(&next->base, memory_order_acquire) ==
+                      base + MPMC_SEGMENT_SIZE) {
+        segment = next;
+        continue;
+      }
+      if (pos >= atomic_load_explicit(&queue->tail, memory_order_relaxed)) {
+        return false;
+      }
+    }
+    /* pos or segment is stale */
+    pos = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    segment = atomic_load_explicit(&queue->head_segment,
+                                   memory_order_acquire);
+  }
+  if (value) {
+    *value = cell->value;
+  }
+  cell->value = NULL;
+  /* The last consumer of a segment hands it back for reuse */
+  if (atomic_fetch_add_explicit(&segment->consumed, 1,
+                                memory_order_acq_rel) +
+          1 ==
+      MPMC_SEGMENT_SIZE) {
+    Lock(queue);
+    SegmentReclaim(queue);
+    Unlock(queue);
+  }
+  return true;
+}
+
+size_t MpmcQueueSize(MpmcQueue *queue) {
+  size_t tail = 0;
+  size_t head = 0;
+
+  if (queue == NULL) {
+    return 0;
+  }
+  head = atomic_load_explicit(&queue->head, memory_order_acquire);
+  tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+  return tail > head ? tail - head : 0;
+}
@@ -0,0 +1,75 @@
+#ifndef INTERPRETER_MPMC_H_
+#define INTERPRETER_MPMC_H_
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define MPMC_CACHE_LINE 64
+#define MPMC_SEGMENT_SIZE 1024 /* Cells in a segment */
+
+/* A cell of a segment; sequence tells whose turn it is to use the cell */
+typedef struct MpmcCell {
+  atomic_size_t sequence;
+  const char *value;
+} MpmcCell;
+
+/* A run of cells holding positions base to base + MPMC_SEGMENT_SIZE - 1 */
+typedef struct MpmcSegment {
+  _Atomic(struct MpmcSegment *) next;
+  atomic_size_t base;
+  atomic_size_t consumed; /* Cells removed since the segment was taken */
+  MpmcCell cells[MPMC_SEGMENT_SIZE];
+} MpmcSegment;
+
+/* An unbounded lock-free multi-producer/multi-consumer queue of strings
+ * on a list of segments of cells (Vyukov's algorithm per cell)
+ * This is a standalone library for programs that feed and drain a queue
+ * from several threads; the interpreter has no such threads, so it is
+ * not a Queue variant and supports none of the Queue calls but insertion
+ * at tail, removal at head and size
+ * The queue holds pointers to strings owned by caller, so neither side
+ * copies them; a producer may carve them out of its own arena
+ * Producers and consumers claim positions by advancing tail and head
+ * with compare-and-swap; no locks are taken for an element
+ * When tail runs off the last segment a new one is linked under a short
+ * spin lock, so insertion never fails for capacity
+ * Segments drained by the consumers are kept and taken again, and only
+ * freed with the queue, so a thread holding a stale segment never reads
+ * freed memory; the sequence of a cell tells which use of the segment it
+ * belongs to, so a stale thread never claims a cell of the wrong one */
+typedef struct MpmcQueue {
+  _Atomic(MpmcSegment *) head_segment; /* Oldest segment not drained */
+  _Atomic(MpmcSegment *) tail_segment;
+  MpmcSegment *free_segment; /* Drained segments, under lock */
+  atomic_flag lock;
+  /* Positions live on their own cache lines to avoid false sharing */
+  _Alignas(MPMC_CACHE_LINE) atomic_size_t tail;
+  _Alignas(MPMC_CACHE_LINE) atomic_size_t head;
+} MpmcQueue;
+
+/* Creates an empty queue
+ * On success, return a pointer to a queue
+ * On error, return NULL */
+MpmcQueue *MpmcQueueNew();
+
+/* Deletes queue, but not the strings left in it
+ * Must not race with other calls on queue
+ * No effect if queue is NULL */
+void MpmcQueueFree(MpmcQueue *queue);
+
+/* Inserts str at tail of queue without copying it, safe to call from
+ * any thread; str must stay valid until it is removed
+ * Return false if queue or str is NULL or a new segment cannot be
+ * allocated */
+bool MpmcQueueInsertTail(MpmcQueue *queue, const char *str);
+
+/* Removes the element at head of queue, safe to call from any thread
+ * If value is not NULL, *value is set to the removed string
+ * Return false if queue is NULL or empty */
+bool MpmcQueueRemoveHead(MpmcQueue *queue, const char **value);
+
+/* Return number of elements in queue, exact only when no other thread
+ * is inserting or removing
+ * Return 0 if queue is NULL */
+size_t MpmcQueueSize(MpmcQueue *queue);
+#endif
@@ -1,6 +1,11 @@
 #include "interpreter_msg.h"
+#include "interpreter_rio.h"
+#include <fcntl.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 bool g_is_visible = false;
 char *g_log_file = NULL;
@@ -36,3 +41,89 @@ void ShowMsg(char *format, ...) {
     va_end(args);
   }
 }
+
+void MsgBufInit(MsgBuf *buf) {
+  if (buf) {
+    memset(buf, 0, sizeof(MsgBuf));
+  }
+}
+
+/* Makes room for len more characters and a null terminator in buf
+ * On success, return true */
+static bool MsgBufReserve(MsgBuf *buf, size_t len) {
+  size_t new_cap = buf->cap ? buf->cap : MSG_BUF_MIN_CAP;
+  char *new_data = NULL;
+
+  if (buf->len + len < buf->cap) {
+    return true;
+  }
+  while (new_cap <= buf->len + len) {
+    new_cap *= 2;
+  }
+  new_data = realloc(buf->data, new_cap);
+  if (new_data == NULL) {
+    return false;
+  }
+  buf->data = new_data;
+  buf->cap = new_cap;
+  return true;
+}
+
+bool MsgBufAppend(MsgBuf *buf, const char *str, size_t len) {
+  if (buf == NULL || str == NULL || !MsgBufReserve(buf, len)) {
+    return false;
+  }
+  memcpy(buf->data + buf->len, str, len);
+  buf->len += len;
+  buf->data[buf->len] = '\0';
+  return true;
+}
+
+bool MsgBufPrintf(MsgBuf *buf, const char *format, ...) {
+  va_list args;
+  int len = 0;
+
+  if (buf == NULL || format == NULL) {
+    return false;
+  }
+  va_start(args, format);
+  len = vsnprintf(NULL, 0, format, args);
+  va_end(args);
+  if (len < 0 || !MsgBufReserve(buf, len)) {
+    return false;
+  }
+  va_start(args, format);
+  vsnprintf(buf->data + buf->len, len + 1, format, args);
+  va_end(args);
+  buf->len += len;
+  return true;
+}
+
+void MsgBufFree(MsgBuf *buf) {
+  if (buf) {
+    free(buf->data);
+    MsgBufInit(buf);
+  }
+}
+
+void ShowMsgBuf(const MsgBuf *buf) {
+  int fd = -1;
+
+  if (buf == NULL || buf->len == 0) {
+    return;
+  }
+  if (g_is_visible) {
+    /* Keeps the order with messages still buffered by stdio */
+    fflush(stdout);
+    WriteNum(STDOUT_FILENO, buf->data, buf->len);
+  }
+  if (g_log_file) {
+    fd = open(g_log_file, O_WRONLY | O_CREAT | O_APPEND, 0666);
+    if (fd < 0) {
+      printf("open file %s failed\n", g_log_file);
+      return;
+    }
+    WriteNum(fd, buf->data, buf->len);
+    close(fd);
+  }
+}
@@ -1,6 +1,17 @@
 #ifndef INTERPRETER_MSG_H_
 #define INTERPRETER_MSG_H_
 #include <stdbool.h>
+#include <stddef.h>
+
+#define MSG_BUF_MIN_CAP 4096
+
+/* Output rendered in memory, e.g., a whole queue, which is written to
+ * each sink at once */
+typedef struct MsgBuf {
+  char *data;
+  size_t len;
+  size_t cap;
+} MsgBuf;
 
 extern bool g_is_visible; /* Shows messages if it's true */
 extern char *g_log_file;  /* Path of log file */
@@ -9,4 +20,24 @@ void SetMsgVisible(bool is_visible);
 void SetLogFile(char *log_file);
 //void LogMsg(char *format, ...);
 void ShowMsg(char *format, ...);
+
+/* Initializes an empty buf
+ * No effect if buf is NULL */
+void MsgBufInit(MsgBuf *buf);
+
+/* Appends len characters of str to buf, growing it by doubling
+ * Return false if buf or str is NULL or memory allocation failed */
+bool MsgBufAppend(MsgBuf *buf, const char *str, size_t len);
+
+/* Appends a formatted string to buf
+ * Return false if buf or format is NULL or memory allocation failed */
+bool MsgBufPrintf(MsgBuf *buf, const char *format, ...);
+
+/* Frees data of buf and leaves it empty
+ * No effect if buf is NULL */
+void MsgBufFree(MsgBuf *buf);
+
+/* Shows buf like ShowMsg() but with one write to the console and one to
+ * the log file */
+void ShowMsgBuf(const MsgBuf *buf);
 #endif
@@ -1,8 +1,13 @@
 #include "interpreter_queue.h"
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 
 Queue *QueueNew() {
+  return QueueNewKind(QUEUE_LIST);
+}
+
+Queue *QueueNewKind(QueueKind kind) {
   Queue *queue = malloc(sizeof(Queue));
 
   if (queue == NULL) {
@@ -12,195 +17,1727 @@ Queue *QueueNew() {
   /*queue->head = NULL;
   queue->tail = NULL;
   queue->size = 0;*/
+  queue->kind = kind;
+  queue->skip_seed = 0x9E3779B97F4A7C15ULL;
+  ArenaInit(&queue->arena);
   return queue;
 }
 
 void QueueFree(Queue *queue) {
-  ListElement *head = NULL;
-  ListElement *next = NULL;
+  QueueMapping *mapping = NULL;
 
   if (queue) {
-    head = queue->head;
-    next = head;
-    while (next) {
-      head = next;
-      if (next->value) {
-        free(next->value);
-      }
-      next = next->next;
-      free(head);
+    /* Nodes, blocks and strings live in the arena, so they are freed
+     * in bulk */
+    ArenaRelease(&queue->arena);
+    free(queue->map);
+    free(queue->block_tree);
+    while (queue->mappings) {
+      mapping = queue->mappings;
+      queue->mappings = mapping->next;
+      munmap(mapping->addr, mapping->size);
+      free(mapping);
     }
     free(queue);
   }
 }
 
-bool QueueInsertHead(Queue *queue, char *str) {
-  int len = 0;
-  ListElement *new_head = NULL;
+/* Return true if str lies in a mapping attached to queue */
+static bool IsMapped(Queue *queue, const char *str) {
+  for (QueueMapping *mapping = queue->mappings; mapping;
+       mapping = mapping->next) {
+    if (str >= (char *)mapping->addr &&
+        str < (char *)mapping->addr + mapping->size) {
+      return true;
+    }
+  }
+  return false;
+}
 
-  if (queue == NULL || str == NULL) {
+/* Stores a copy of str of len characters for queue, a shared one if
+ * queue interns strings
+ * A string in a mapping of queue is referred to, not copied
+ * On success, return the copy
+ * On error, return NULL */
+static char *StringNew(Queue *queue, const char *str, size_t len) {
+  if (queue->is_interned) {
+    return InternAcquire(&queue->intern, str, len);
+  }
+  if (IsMapped(queue, str)) {
+    return (char *)str;
+  }
+  return ArenaStrndup(&queue->arena, str, len);
+}
+
+/* Frees value of len characters returned by StringNew() */
+static void StringFree(Queue *queue, char *value, size_t len) {
+  if (IsMapped(queue, value)) {
+    return;
+  }
+  if (queue->is_interned) {
+    InternRelease(&queue->intern, value);
+  } else {
+    ArenaFree(&queue->arena, value, len + 1);
+  }
+}
+
+/* Accounts a string of len characters entering queue */
+static void CountString(Queue *queue, size_t len) {
+  queue->len_sum += len;
+  if (len > queue->max_len) {
+    queue->max_len = len;
+  }
+}
+
+/* Gets bytes of nodes, strings and overhead of queue */
+static void CountBytes(Queue *queue, size_t *node_bytes, size_t *string_bytes,
+                       size_t *overhead_bytes) {
+  size_t used = ArenaUsed(&queue->arena);
+
+  *node_bytes = queue->node_bytes +
+                queue->map_cap * (sizeof(QueueBlock *) + sizeof(int));
+  *string_bytes = used - queue->node_bytes;
+  *overhead_bytes = ArenaReserved(&queue->arena) - used;
+}
+
+/* Raises peaks of queue to its current bytes */
+static void UpdatePeaks(Queue *queue) {
+  size_t node_bytes = 0;
+  size_t string_bytes = 0;
+  size_t overhead_bytes = 0;
+
+  CountBytes(queue, &node_bytes, &string_bytes, &overhead_bytes);
+  if (node_bytes > queue->node_peak) {
+    queue->node_peak = node_bytes;
+  }
+  if (string_bytes > queue->string_peak) {
+    queue->string_peak = string_bytes;
+  }
+  if (overhead_bytes > queue->overhead_peak) {
+    queue->overhead_peak = overhead_bytes;
+  }
+}
+
+bool QueueAttachMapping(Queue *queue, void *mapping, size_t mapping_size) {
+  QueueMapping *new_mapping = NULL;
+
+  if (queue == NULL || mapping == NULL) {
     return false;
   }
-  len = strlen(str);
-  new_head = malloc(sizeof(ListElement));
-  if (new_head == NULL) {
+  new_mapping = malloc(sizeof(QueueMapping));
+  if (new_mapping == NULL) {
     return false;
   }
-  new_head->value = malloc((len + 1) * sizeof(char));
-  if (new_head->value == NULL) {
-    free(new_head);
+  new_mapping->addr = mapping;
+  new_mapping->size = mapping_size;
+  new_mapping->next = queue->mappings;
+  queue->mappings = new_mapping;
+  return true;
+}
+
+bool QueueEnableIntern(Queue *queue) {
+  if (queue == NULL || queue->size > 0) {
     return false;
   }
-  memset(new_head->value, 0, (len + 1) * sizeof(char));
-  strncpy(new_head->value, str, len);
-  new_head->value[len] = '\0';
-  new_head->next = NULL;
+  if (!queue->is_interned) {
+    InternInit(&queue->intern, &queue->arena);
+    queue->is_interned = true;
+  }
+  return true;
+}
+
+/* Return number of elements in block */
+static int BlockCount(const QueueBlock *block) {
+  return block->end - block->begin;
+}
+
+/* Return true if map[map_idx] is a block of a chunked queue between the
+ * first and the last one */
+static bool IsInnerBlock(Queue *queue, int map_idx) {
+  return map_idx > queue->map_first &&
+         map_idx < queue->map_first + queue->block_num - 1;
+}
+
+/* Adds delta to the count of map[map_idx] in the block tree of queue */
+static void TreeAdd(Queue *queue, int map_idx, int delta) {
+  for (int i = map_idx + 1; i <= queue->map_cap; i += i & -i) {
+    queue->block_tree[i] += delta;
+  }
+}
+
+/* Rebuilds the block tree of queue from counts of its inner blocks in
+ * O(map_cap) */
+static void TreeBuild(Queue *queue) {
+  int *tree = queue->block_tree;
+  int parent = 0;
+
+  memset(tree, 0, (queue->map_cap + 1) * sizeof(int));
+  for (int i = 1; i < queue->block_num - 1; i++) {
+    tree[queue->map_first + i + 1] =
+        BlockCount(queue->map[queue->map_first + i]);
+  }
+  for (int i = 1; i <= queue->map_cap; i++) {
+    parent = i + (i & -i);
+    if (parent <= queue->map_cap) {
+      tree[parent] += tree[i];
+    }
+  }
+}
+
+/* Finds the inner block holding the element *pos elements after the
+ * first one of the inner blocks of queue, and sets *pos to its offset
+ * in the block
+ * Return the position of the block in map */
+static int TreeFind(Queue *queue, int *pos) {
+  int idx = 0;
+
+  /* map_cap is a power of 2, so the search halves it down to 1 */
+  for (int step = queue->map_cap; step > 0; step /= 2) {
+    if (idx + step <= queue->map_cap &&
+        queue->block_tree[idx + step] <= *pos) {
+      idx += step;
+      *pos -= queue->block_tree[idx];
+    }
+  }
+  return idx;
+}
+
+/* Makes room in map of a chunked queue for num new blocks at the front
+ * if at_front is true, otherwise at the back
+ * On success, return true */
+static bool MapReserve(Queue *queue, bool at_front, int num) {
+  QueueBlock **new_map = NULL;
+  int *new_tree = NULL;
+  int new_cap = queue->map_cap;
+  int new_first = 0;
+
+  if (at_front ? queue->map_first >= num
+               : queue->map_first + queue->block_num + num <= queue->map_cap) {
+    return true;
+  }
+  /* Doubles the map only when it would be more than half full,
+   * otherwise recenters blocks in the same capacity */
+  if (new_cap < 8) {
+    new_cap = 8;
+  }
+  while (queue->block_num + num > new_cap / 2) {
+    new_cap *= 2;
+  }
+  new_map = malloc(new_cap * sizeof(QueueBlock *));
+  new_tree = malloc((new_cap + 1) * sizeof(int));
+  if (new_map == NULL || new_tree == NULL) {
+    free(new_map);
+    free(new_tree);
+    return false;
+  }
+  new_first = (new_cap - queue->block_num) / 2;
+  if (queue->block_num > 0) {
+    memcpy(new_map + new_first, queue->map + queue->map_first,
+           queue->block_num * sizeof(QueueBlock *));
+  }
+  free(queue->map);
+  free(queue->block_tree);
+  queue->map = new_map;
+  queue->block_tree = new_tree;
+  queue->map_cap = new_cap;
+  queue->map_first = new_first;
+  /* Blocks moved, so the tree is rebuilt as often as the map is copied */
+  TreeBuild(queue);
+  return true;
+}
+
+/* Adds an empty block at the front of a chunked queue if at_front is
+ * true, otherwise at the back
+ * On success, return the block */
+static QueueBlock *BlockPush(Queue *queue, bool at_front) {
+  QueueBlock *block = NULL;
+  int end_idx = 0;
+
+  if (!MapReserve(queue, at_front, 1)) {
+    return NULL;
+  }
+  block = ArenaAlloc(&queue->arena, sizeof(QueueBlock));
+  if (block == NULL) {
+    return NULL;
+  }
+  queue->node_bytes += sizeof(QueueBlock);
+  block->begin = block->end = at_front ? QUEUE_BLOCK_SLOTS : 0;
+  /* The end block on this side becomes an inner one */
+  if (queue->block_num >= 2) {
+    end_idx = at_front ? queue->map_first
+                       : queue->map_first + queue->block_num - 1;
+    TreeAdd(queue, end_idx, BlockCount(queue->map[end_idx]));
+  }
+  if (at_front) {
+    queue->map_first--;
+    queue->map[queue->map_first] = block;
+  } else {
+    queue->map[queue->map_first + queue->block_num] = block;
+  }
+  queue->block_num++;
+  return block;
+}
+
+/* Frees empty blocks at both ends of a chunked queue
+ * An inner block which becomes an end one leaves the block tree */
+static void BlockPopEmpty(Queue *queue) {
+  QueueBlock *block = NULL;
+  int end_idx = 0;
+
+  while (queue->block_num > 0) {
+    block = queue->map[queue->map_first];
+    if (BlockCount(block) > 0) {
+      break;
+    }
+    ArenaFree(&queue->arena, block, sizeof(QueueBlock));
+    queue->node_bytes -= sizeof(QueueBlock);
+    queue->map_first++;
+    queue->block_num--;
+    if (queue->block_num >= 2) {
+      TreeAdd(queue, queue->map_first,
+              -BlockCount(queue->map[queue->map_first]));
+    }
+  }
+  while (queue->block_num > 0) {
+    end_idx = queue->map_first + queue->block_num - 1;
+    block = queue->map[end_idx];
+    if (BlockCount(block) > 0) {
+      break;
+    }
+    ArenaFree(&queue->arena, block, sizeof(QueueBlock));
+    queue->node_bytes -= sizeof(QueueBlock);
+    queue->block_num--;
+    if (queue->block_num >= 2) {
+      TreeAdd(queue, end_idx - 1, -BlockCount(queue->map[end_idx - 1]));
+    }
+  }
+}
+
+/* Fills slot with a copy of str of len characters from arena of queue
+ * On success, return true */
+static bool SlotSet(Queue *queue, QueueSlot *slot, const char *str,
+                    size_t len) {
+  slot->value = StringNew(queue, str, len);
+  if (slot->value == NULL) {
+    return false;
+  }
+  slot->len = len;
+  CountString(queue, len);
+  return true;
+}
+
+/* Frees the string of slot of a chunked queue */
+static void SlotFree(Queue *queue, QueueSlot *slot) {
+  StringFree(queue, slot->value, slot->len);
+  queue->len_sum -= slot->len;
+}
+
+static bool ChunkedInsertHead(Queue *queue, const char *str, size_t len) {
+  QueueBlock *block = NULL;
+
+  if (queue->block_num > 0) {
+    block = queue->map[queue->map_first];
+  }
+  if (block == NULL || block->begin == 0) {
+    block = BlockPush(queue, true);
+    if (block == NULL) {
+      return false;
+    }
+  }
+  if (!SlotSet(queue, &block->slots[block->begin - 1], str, len)) {
+    return false;
+  }
+  block->begin--;
+  queue->size++;
+  return true;
+}
+
+static bool ChunkedInsertTail(Queue *queue, const char *str, size_t len) {
+  QueueBlock *block = NULL;
+
+  if (queue->block_num > 0) {
+    block = queue->map[queue->map_first + queue->block_num - 1];
+  }
+  if (block == NULL || block->end == QUEUE_BLOCK_SLOTS) {
+    block = BlockPush(queue, false);
+    if (block == NULL) {
+      return false;
+    }
+  }
+  if (!SlotSet(queue, &block->slots[block->end], str, len)) {
+    return false;
+  }
+  block->end++;
+  queue->size++;
+  return true;
+}
+
+static bool ChunkedRemoveHead(Queue *queue) {
+  QueueBlock *block = NULL;
+
+  if (queue->size == 0) {
+    return false;
+  }
+  block = queue->map[queue->map_first];
+  SlotFree(queue, &block->slots[block->begin]);
+  block->begin++;
+  queue->size--;
+  BlockPopEmpty(queue);
+  return true;
+}
+
+/* Removes the last element of a chunked queue
+ * Return false if queue is empty */
+static bool ChunkedRemoveTail(Queue *queue) {
+  QueueBlock *block = NULL;
+
+  if (queue->size == 0) {
+    return false;
+  }
+  block = queue->map[queue->map_first + queue->block_num - 1];
+  block->end--;
+  SlotFree(queue, &block->slots[block->end]);
+  queue->size--;
+  BlockPopEmpty(queue);
+  return true;
+}
+
+/* Return the slot at physical position pos of a chunked queue and sets
+ * *map_idx to the position of its block in map
+ * The end blocks are checked first, the inner ones are searched in the
+ * block tree */
+static QueueSlot *ChunkedSlot(Queue *queue, int pos, int *map_idx) {
+  QueueBlock *first = queue->map[queue->map_first];
+  QueueBlock *last = queue->map[queue->map_first + queue->block_num - 1];
+  QueueBlock *block = NULL;
+
+  if (pos < BlockCount(first)) {
+    *map_idx = queue->map_first;
+    return &first->slots[first->begin + pos];
+  }
+  if (pos >= queue->size - BlockCount(last)) {
+    *map_idx = queue->map_first + queue->block_num - 1;
+    return &last->slots[last->begin + pos - (queue->size - BlockCount(last))];
+  }
+  pos -= BlockCount(first);
+  *map_idx = TreeFind(queue, &pos);
+  block = queue->map[*map_idx];
+  return &block->slots[block->begin + pos];
+}
+
+/* Removes the element at physical position pos of a chunked queue,
+ * moving the fewer of the slots before and after it in its block */
+static void ChunkedDelete(Queue *queue, int pos) {
+  QueueBlock *block = NULL;
+  QueueSlot *slot = NULL;
+  int map_idx = 0;
+  int slot_idx = 0;
+
+  slot = ChunkedSlot(queue, pos, &map_idx);
+  block = queue->map[map_idx];
+  slot_idx = slot - block->slots;
+  SlotFree(queue, slot);
+  if (slot_idx - block->begin < block->end - 1 - slot_idx) {
+    memmove(&block->slots[block->begin + 1], &block->slots[block->begin],
+            (slot_idx - block->begin) * sizeof(QueueSlot));
+    block->begin++;
+  } else {
+    memmove(&block->slots[slot_idx], &block->slots[slot_idx + 1],
+            (block->end - 1 - slot_idx) * sizeof(QueueSlot));
+    block->end--;
+  }
+  queue->size--;
+  /* An inner block left empty stays until it becomes an end one */
+  if (IsInnerBlock(queue, map_idx)) {
+    TreeAdd(queue, map_idx, -1);
+  } else {
+    BlockPopEmpty(queue);
+  }
+}
+
+/* Moves slots of a chunked queue whose value is NULL out, packing the
+ * rest toward the front in order, and frees blocks left over
+ * Every block but the first and the last ends up full */
+static void ChunkedCompact(Queue *queue) {
+  QueueBlock *block = NULL;
+  QueueBlock *write_block = NULL;
+  int write_idx = 0;
+  int write_slot = 0;
+
+  write_block = queue->map[queue->map_first];
+  write_slot = write_block->begin;
+  for (int i = 0; i < queue->block_num; i++) {
+    block = queue->map[queue->map_first + i];
+    for (int j = block->begin; j < block->end; j++) {
+      if (block->slots[j].value == NULL) {
+        continue;
+      }
+      if (write_slot == QUEUE_BLOCK_SLOTS) {
+        write_block->end = QUEUE_BLOCK_SLOTS;
+        write_idx++;
+        write_block = queue->map[queue->map_first + write_idx];
+        write_block->begin = write_slot = 0;
+      }
+      write_block->slots[write_slot++] = block->slots[j];
+    }
+  }
+  write_block->end = write_slot;
+  for (int i = write_idx + 1; i < queue->block_num; i++) {
+    ArenaFree(&queue->arena, queue->map[queue->map_first + i],
+              sizeof(QueueBlock));
+    queue->node_bytes -= sizeof(QueueBlock);
+  }
+  queue->block_num = write_idx + 1;
+  BlockPopEmpty(queue);
+  TreeBuild(queue);
+}
+
+/* Return the length of str, the i-th of packed strings, taken from
+ * their offsets if they are given instead of measuring it */
+static size_t PackedLen(const char *str, const uint64_t *offsets, int i) {
+  return offsets ? offsets[i + 1] - offsets[i] - 1 : strlen(str);
+}
+
+/* Inserts num packed strings into a chunked queue one slot at a time,
+ * at the front if at_front is true, otherwise at the back, measuring
+ * them unless their offsets are given
+ * Inserted strings are removed again if memory allocation failed
+ * On success, return true */
+static bool ChunkedInsertBatch(Queue *queue, const char *strs,
+                               const uint64_t *offsets, int num,
+                               bool at_front) {
+  size_t len = 0;
+  bool is_inserted = false;
+
+  for (int i = 0; i < num; i++) {
+    len = PackedLen(strs, offsets, i);
+    if (at_front) {
+      is_inserted = ChunkedInsertHead(queue, strs, len);
+    } else {
+      is_inserted = ChunkedInsertTail(queue, strs, len);
+    }
+    if (!is_inserted) {
+      while (i-- > 0) {
+        if (at_front) {
+          ChunkedRemoveHead(queue);
+        } else {
+          ChunkedRemoveTail(queue);
+        }
+      }
+      return false;
+    }
+    strs += len + 1;
+  }
+  return true;
+}
+
+/* Replaces the string of element by a copy of str of len characters
+ * Short strings are stored inline unless queue interns strings or they
+ * are in a mapping of queue, long strings spill to the arena
+ * On success, return true; element is unchanged on error */
+static bool ElementSetValue(Queue *queue, ListElement *element,
+                            const char *str, size_t len) {
+  char *value = NULL;
+
+  if (len >= LIST_ELEMENT_INLINE_SIZE || queue->is_interned ||
+      IsMapped(queue, str)) {
+    value = StringNew(queue, str, len);
+    if (value == NULL) {
+      return false;
+    }
+  }
+  if (element->value != element->inline_value) {
+    StringFree(queue, element->value, element->len);
+  }
+  if (value == NULL) {
+    memcpy(element->inline_value, str, len + 1);
+    value = element->inline_value;
+  }
+  queue->len_sum -= element->len;
+  element->value = value;
+  element->len = len;
+  CountString(queue, len);
+  return true;
+}
+
+/* Allocates an element holding a copy of str of len characters from
+ * arena of queue, stored as by ElementSetValue()
+ * On success, return the element whose next is NULL
+ * On error, return NULL */
+static ListElement *ElementNew(Queue *queue, const char *str, size_t len) {
+  ListElement *element = NULL;
+
+  element = ArenaAlloc(&queue->arena, sizeof(ListElement));
+  if (element == NULL) {
+    return NULL;
+  }
+  element->value = element->inline_value;
+  element->len = 0;
+  if (!ElementSetValue(queue, element, str, len)) {
+    ArenaFree(&queue->arena, element, sizeof(ListElement));
+    return NULL;
+  }
+  element->next = NULL;
+  element->prev = NULL;
+  queue->node_bytes += sizeof(ListElement);
+  return element;
+}
+
+/* Returns memory of element to arena of queue */
+static void ElementFree(Queue *queue, ListElement *element) {
+  if (element->value != element->inline_value) {
+    StringFree(queue, element->value, element->len);
+  }
+  queue->node_bytes -= sizeof(ListElement);
+  queue->len_sum -= element->len;
+  ArenaFree(&queue->arena, element, sizeof(ListElement));
+}
+
+/* Links the chain first..last in front of the first element of a list
+ * queue */
+static void ListSpliceFront(Queue *queue, ListElement *first,
+                            ListElement *last) {
+  last->next = queue->head;
   if (queue->head) {
-    new_head->next = queue->head;
-    if (queue->tail == NULL) {
-      queue->tail = queue->head;
+    queue->head->prev = last;
+  } else {
+    queue->tail = last;
+  }
+  queue->head = first;
+}
+
+/* Links the chain first..last after the last element of a list queue */
+static void ListSpliceBack(Queue *queue, ListElement *first,
+                           ListElement *last) {
+  first->prev = queue->tail;
+  if (queue->tail) {
+    queue->tail->next = first;
+  } else {
+    queue->head = first;
+  }
+  queue->tail = last;
+}
+
+/* Unlinks and frees element of a list or sorted queue
+ * The tower of element, if any, is left to caller */
+static void ListUnlink(Queue *queue, ListElement *element) {
+  if (element->prev) {
+    element->prev->next = element->next;
+  } else {
+    queue->head = element->next;
+  }
+  if (element->next) {
+    element->next->prev = element->prev;
+  } else {
+    queue->tail = element->prev;
+  }
+  ElementFree(queue, element);
+  queue->size--;
+}
+
+/* Unlinks and frees the first element of a non-empty list queue if
+ * at_front is true, otherwise the last one */
+static void ListRemove(Queue *queue, bool at_front) {
+  ListUnlink(queue, at_front ? queue->head : queue->tail);
+}
+
+/* Return the number of levels of a new tower of a sorted queue; 0 with
+ * probability 1 - 1 / SKIP_FANOUT, which means no tower */
+static int SkipLevel(Queue *queue) {
+  uint64_t bits = 0;
+  int level = 0;
+
+  /* xorshift64 */
+  queue->skip_seed ^= queue->skip_seed << 13;
+  queue->skip_seed ^= queue->skip_seed >> 7;
+  queue->skip_seed ^= queue->skip_seed << 17;
+  bits = queue->skip_seed;
+  while (level < SKIP_MAX_LEVEL && bits % SKIP_FANOUT == 0) {
+    level++;
+    bits /= SKIP_FANOUT;
+  }
+  return level;
+}
+
+/* Allocates a tower of random height standing on element of a sorted
+ * queue into *tower, which is NULL if the element gets no tower
+ * On success, return true */
+static bool TowerNew(Queue *queue, ListElement *element, SkipTower **tower) {
+  int level = SkipLevel(queue);
+
+  *tower = NULL;
+  if (level == 0) {
+    return true;
+  }
+  *tower = ArenaAlloc(&queue->arena,
+                      sizeof(SkipTower) + level * sizeof(SkipLink));
+  if (*tower == NULL) {
+    return false;
+  }
+  (*tower)->element = element;
+  (*tower)->level = level;
+  queue->node_bytes += sizeof(SkipTower) + level * sizeof(SkipLink);
+  return true;
+}
+
+/* Returns memory of tower to arena of queue
+ * No effect if tower is NULL */
+static void TowerFree(Queue *queue, SkipTower *tower) {
+  size_t size = 0;
+
+  if (tower) {
+    size = sizeof(SkipTower) + tower->level * sizeof(SkipLink);
+    queue->node_bytes -= size;
+    ArenaFree(&queue->arena, tower, size);
+  }
+}
+
+/* Return the span of tower on level of a sorted queue, or the one of the
+ * place before head if tower is NULL */
+static int *SkipSpan(Queue *queue, SkipTower *tower, int level) {
+  return tower ? &tower->links[level].span : &queue->skip_span[level];
+}
+
+/* Links element with its tower, which may be NULL, into a sorted queue
+ * after the elements not greater than it
+ * The towers lead to the last tower not greater than element, from
+ * where a few steps along the list find its place; the positions of the
+ * towers passed tell how to split the spans over it */
+static void SortedLink(Queue *queue, ListElement *element, SkipTower *tower) {
+  SkipTower *update[SKIP_MAX_LEVEL];
+  int update_pos[SKIP_MAX_LEVEL]; /* -1 for the place before head */
+  SkipTower *current = NULL;
+  SkipTower *next = NULL;
+  ListElement *prev = NULL;
+  ListElement *following = NULL;
+  int pos = -1;
+  int *span = NULL;
+
+  for (int level = queue->skip_level - 1; level >= 0; level--) {
+    next = current ? current->links[level].next : queue->skip_head[level];
+    while (next && strcmp(next->element->value, element->value) <= 0) {
+      pos += *SkipSpan(queue, current, level);
+      current = next;
+      next = current->links[level].next;
     }
-    queue->head = new_head;
+    update[level] = current;
+    update_pos[level] = pos;
+  }
+  prev = current ? current->element : NULL;
+  following = prev ? prev->next : queue->head;
+  while (following && strcmp(following->value, element->value) <= 0) {
+    prev = following;
+    following = following->next;
+    pos++;
+  }
+  pos++;
+  element->prev = prev;
+  element->next = following;
+  if (prev) {
+    prev->next = element;
+  } else {
+    queue->head = element;
+  }
+  if (following) {
+    following->prev = element;
   } else {
-    queue->head = new_head;
-    if (queue->tail == NULL) {
-      queue->tail = queue->head;
+    queue->tail = element;
+  }
+  /* A level new to the queue spans it from before head to its end */
+  for (; tower && queue->skip_level < tower->level; queue->skip_level++) {
+    update[queue->skip_level] = NULL;
+    update_pos[queue->skip_level] = -1;
+    queue->skip_span[queue->skip_level] = queue->size + 1;
+  }
+  queue->size++;
+  for (int level = 0; level < queue->skip_level; level++) {
+    span = SkipSpan(queue, update[level], level);
+    if (tower == NULL || level >= tower->level) {
+      (*span)++;
+      continue;
+    }
+    tower->links[level].span = *span - (pos - update_pos[level]) + 1;
+    *span = pos - update_pos[level];
+    if (update[level]) {
+      tower->links[level].next = update[level]->links[level].next;
+      update[level]->links[level].next = tower;
+    } else {
+      tower->links[level].next = queue->skip_head[level];
+      queue->skip_head[level] = tower;
+    }
+  }
+}
+
+/* Inserts num packed strings into a sorted queue in order, measuring
+ * them unless their offsets are given
+ * Elements and towers are allocated before any is linked
+ * On success, return true */
+static bool SortedInsertBatch(Queue *queue, const char *strs,
+                              const uint64_t *offsets, int num) {
+  ListElement **elements = malloc(num * sizeof(ListElement *));
+  SkipTower **towers = malloc(num * sizeof(SkipTower *));
+  size_t len = 0;
+  int i = 0;
+
+  if (elements == NULL || towers == NULL) {
+    free(elements);
+    free(towers);
+    return false;
+  }
+  for (i = 0; i < num; i++) {
+    len = PackedLen(strs, offsets, i);
+    elements[i] = ElementNew(queue, strs, len);
+    if (elements[i] == NULL || !TowerNew(queue, elements[i], &towers[i])) {
+      if (elements[i]) {
+        ElementFree(queue, elements[i]);
+      }
+      while (i-- > 0) {
+        TowerFree(queue, towers[i]);
+        ElementFree(queue, elements[i]);
+      }
+      free(elements);
+      free(towers);
+      return false;
+    }
+    strs += len + 1;
+  }
+  for (i = 0; i < num; i++) {
+    SortedLink(queue, elements[i], towers[i]);
+  }
+  free(elements);
+  free(towers);
+  return true;
+}
+
+/* Unlinks and frees element of a sorted queue and its tower, which is
+ * NULL if it has none, where update[level] is the last tower before
+ * element on each level or NULL if there is none */
+static void SortedUnlink(Queue *queue, ListElement *element, SkipTower *tower,
+                         SkipTower **update) {
+  int *span = NULL;
+
+  for (int level = 0; level < queue->skip_level; level++) {
+    span = SkipSpan(queue, update[level], level);
+    if (tower == NULL || level >= tower->level) {
+      (*span)--;
+    } else if (update[level]) {
+      *span += tower->links[level].span - 1;
+      update[level]->links[level].next = tower->links[level].next;
+    } else {
+      *span += tower->links[level].span - 1;
+      queue->skip_head[level] = tower->links[level].next;
+    }
+  }
+  while (queue->skip_level > 0 &&
+         queue->skip_head[queue->skip_level - 1] == NULL) {
+    queue->skip_level--;
+  }
+  TowerFree(queue, tower);
+  ListUnlink(queue, element);
+}
+
+/* Unlinks and frees the smallest element of a non-empty sorted queue
+ * Its tower, if any, is first on every level it has */
+static void SortedRemoveHead(Queue *queue) {
+  SkipTower *update[SKIP_MAX_LEVEL] = {NULL};
+  SkipTower *tower = queue->skip_head[0];
+
+  if (tower && tower->element != queue->head) {
+    tower = NULL;
+  }
+  SortedUnlink(queue, queue->head, tower, update);
+}
+
+/* Return the element at position pos of a sorted queue, setting
+ * update[level] to the last tower before it on each level, or NULL if
+ * there is none
+ * The spans lead to the last tower before pos, from where a few steps
+ * along the list reach it */
+static ListElement *SortedAt(Queue *queue, int pos, SkipTower **update) {
+  SkipTower *current = NULL;
+  SkipTower *next = NULL;
+  ListElement *element = NULL;
+  int current_pos = -1;
+
+  for (int level = queue->skip_level - 1; level >= 0; level--) {
+    next = current ? current->links[level].next : queue->skip_head[level];
+    while (next && current_pos + *SkipSpan(queue, current, level) < pos) {
+      current_pos += *SkipSpan(queue, current, level);
+      current = next;
+      next = current->links[level].next;
     }
+    update[level] = current;
+  }
+  element = current ? current->element : NULL;
+  for (; current_pos < pos; current_pos++) {
+    element = element ? element->next : queue->head;
+  }
+  return element;
+}
+
+/* Unlinks and frees the element at position pos of a sorted queue */
+static void SortedDelete(Queue *queue, int pos) {
+  SkipTower *update[SKIP_MAX_LEVEL] = {NULL};
+  SkipTower *tower = NULL;
+  ListElement *element = SortedAt(queue, pos, update);
+
+  if (queue->skip_level > 0) {
+    tower = update[0] ? update[0]->links[0].next : queue->skip_head[0];
+  }
+  if (tower && tower->element != element) {
+    tower = NULL;
+  }
+  SortedUnlink(queue, element, tower, update);
+}
+
+/* Inserts str at the front of queue if at_front is true, otherwise at
+ * the back
+ * On success, return true */
+static bool InsertOne(Queue *queue, const char *str, bool at_front) {
+  ListElement *element = NULL;
+  size_t len = strlen(str);
+
+  if (queue->kind == QUEUE_CHUNKED) {
+    return at_front ? ChunkedInsertHead(queue, str, len)
+                    : ChunkedInsertTail(queue, str, len);
+  }
+  if (queue->kind == QUEUE_SORTED) {
+    return SortedInsertBatch(queue, str, NULL, 1);
+  }
+  element = ElementNew(queue, str, len);
+  if (element == NULL) {
+    return false;
+  }
+  if (at_front) {
+    ListSpliceFront(queue, element, element);
+  } else {
+    ListSpliceBack(queue, element, element);
   }
   queue->size++;
   return true;
 }
 
+/* The logical head is the physical back when the queue is reversed */
+bool QueueInsertHead(Queue *queue, char *str) {
+  bool is_inserted = false;
+
+  if (queue == NULL || str == NULL) {
+    return false;
+  }
+  is_inserted = InsertOne(queue, str, !queue->is_reversed);
+  UpdatePeaks(queue);
+  return is_inserted;
+}
+
 bool QueueInsertTail(Queue *queue, char *str) {
-  int length = 0;
-  ListElement *new_tail = NULL;
+  bool is_inserted = false;
 
   if (queue == NULL || str == NULL) {
     return false;
   }
-  length = strlen(str);
-  new_tail = malloc(sizeof(ListElement));
-  if (new_tail == NULL) {
+  is_inserted = InsertOne(queue, str, queue->is_reversed);
+  UpdatePeaks(queue);
+  return is_inserted;
+}
+
+/* Builds a chain of elements from num packed strings, measuring them
+ * unless their offsets are given
+ * The chain is in insertion order, or in reverse order if at_front is
+ * true, so that it can be spliced at the front
+ * On success, return the first element of the chain and sets *last
+ * On error, return NULL and nothing is left allocated */
+static ListElement *ChainNew(Queue *queue, const char *strs,
+                             const uint64_t *offsets, int num,
+                             bool at_front, ListElement **last) {
+  ListElement *first = NULL;
+  ListElement *element = NULL;
+  size_t len = 0;
+
+  *last = NULL;
+  for (int i = 0; i < num; i++) {
+    len = PackedLen(strs, offsets, i);
+    element = ElementNew(queue, strs, len);
+    if (element == NULL) {
+      while (first) {
+        element = first;
+        first = first->next;
+        ElementFree(queue, element);
+      }
+      return NULL;
+    }
+    if (*last == NULL) {
+      first = *last = element;
+    } else if (at_front) {
+      element->next = first;
+      first->prev = element;
+      first = element;
+    } else {
+      element->prev = *last;
+      (*last)->next = element;
+      *last = element;
+    }
+    strs += len + 1;
+  }
+  return first;
+}
+
+/* Inserts num packed strings at the front of queue if at_front is true,
+ * otherwise at the back, measuring them unless offsets is given
+ * On success, return true */
+static bool InsertBatch(Queue *queue, const char *strs,
+                        const uint64_t *offsets, int num, bool at_front) {
+  ListElement *first = NULL;
+  ListElement *last = NULL;
+
+  if (num == 0) {
+    return true;
+  }
+  if (queue->kind == QUEUE_CHUNKED) {
+    return ChunkedInsertBatch(queue, strs, offsets, num, at_front);
+  }
+  if (queue->kind == QUEUE_SORTED) {
+    return SortedInsertBatch(queue, strs, offsets, num);
+  }
+  first = ChainNew(queue, strs, offsets, num, at_front, &last);
+  if (first == NULL) {
+    return false;
+  }
+  if (at_front) {
+    ListSpliceFront(queue, first, last);
+  } else {
+    ListSpliceBack(queue, first, last);
+  }
+  queue->size += num;
+  return true;
+}
+
+bool QueueInsertHeadBatch(Queue *queue, const char *strs, int num) {
+  bool is_inserted = false;
+
+  if (queue == NULL || strs == NULL || num < 0) {
+    return false;
+  }
+  is_inserted = InsertBatch(queue, strs, NULL, num, !queue->is_reversed);
+  UpdatePeaks(queue);
+  return is_inserted;
+}
+
+bool QueueInsertTailBatch(Queue *queue, const char *strs, int num) {
+  bool is_inserted = false;
+
+  if (queue == NULL || strs == NULL || num < 0) {
     return false;
   }
-  new_tail->value = malloc(length + 1);
-  if (new_tail->value == NULL) {
-    free(new_tail);
+  is_inserted = InsertBatch(queue, strs, NULL, num, queue->is_reversed);
+  UpdatePeaks(queue);
+  return is_inserted;
+}
+
+bool QueueInsertTailPacked(Queue *queue, const char *strs,
+                           const uint64_t *offsets, int num) {
+  bool is_inserted = false;
+
+  if (queue == NULL || strs == NULL || offsets == NULL || num < 0) {
+    return false;
+  }
+  is_inserted = InsertBatch(queue, strs, offsets, num, queue->is_reversed);
+  UpdatePeaks(queue);
+  return is_inserted;
+}
+
+bool QueueRemoveHead(Queue *queue) {
+  if (queue == NULL || queue->size == 0) {
     return false;
   }
-  strncpy(new_tail->value, str, length);
-  new_tail->value[length] = '\0';
-  new_tail->next = NULL;
-  if (queue->tail == NULL) {
-    queue->tail = new_tail;
-    if (queue->head == NULL) {
-      queue->head = queue->tail;
+  if (queue->kind == QUEUE_CHUNKED) {
+    if (queue->is_reversed) {
+      ChunkedRemoveTail(queue);
+    } else {
+      ChunkedRemoveHead(queue);
     }
+  } else if (queue->kind == QUEUE_SORTED) {
+    SortedRemoveHead(queue);
+  } else {
+    ListRemove(queue, !queue->is_reversed);
+  }
+  /* Removal turns bytes in use into overhead */
+  UpdatePeaks(queue);
+  return true;
+}
+
+/* An open addressing set of strings with linear probing, which refers to
+ * strings of a queue instead of copying them
+ * Strings of an interned queue are equal only if they are the same copy,
+ * so their addresses are hashed and compared instead */
+typedef struct StringSet {
+  const char **slots;
+  size_t mask; /* Number of slots minus 1, a power of 2 minus 1 */
+  bool is_by_address;
+} StringSet;
+
+/* Initializes an empty set for up to num strings, kept at most 3/4 full
+ * On success, return true */
+static bool StringSetInit(StringSet *set, int num, bool is_by_address) {
+  size_t cap = 8;
+
+  while (cap * 3 / 4 < (size_t)num) {
+    cap *= 2;
+  }
+  set->slots = calloc(cap, sizeof(const char *));
+  set->mask = cap - 1;
+  set->is_by_address = is_by_address;
+  return set->slots != NULL;
+}
+
+/* Adds str of len characters to set
+ * Return false if an equal string is in set already */
+static bool StringSetAdd(StringSet *set, const char *str, size_t len) {
+  size_t idx = 0;
+
+  if (set->is_by_address) {
+    idx = ((uintptr_t)str >> 3) * 0x9E3779B97F4A7C15ULL >> 32;
   } else {
-    if (queue->head == NULL) {
-      queue->head = queue->tail;
+    idx = InternHash(str, len);
+  }
+  for (idx &= set->mask; set->slots[idx]; idx = (idx + 1) & set->mask) {
+    if (set->is_by_address ? set->slots[idx] == str
+                           : strcmp(set->slots[idx], str) == 0) {
+      return false;
     }
-    queue->tail->next = new_tail;
-    queue->tail = new_tail;
   }
-  queue->size++;
+  set->slots[idx] = str;
   return true;
 }
 
-bool QueueRemoveHead(Queue *queue) {
-  ListElement *remove_element = NULL;
+/* Removes repeated elements of a list queue, walking from the logical
+ * head */
+static void ListDedup(Queue *queue, StringSet *set) {
+  ListElement *element = queue->is_reversed ? queue->tail : queue->head;
+  ListElement *next = NULL;
 
-  if (queue == NULL || queue->head == NULL || queue->size == 0) {
+  while (element) {
+    next = queue->is_reversed ? element->prev : element->next;
+    if (!StringSetAdd(set, element->value, element->len)) {
+      ListUnlink(queue, element);
+    }
+    element = next;
+  }
+}
+
+/* Removes repeated elements of a chunked queue, walking from the logical
+ * head; their slots are cleared first and compacted away at once */
+static void ChunkedDedup(Queue *queue, StringSet *set) {
+  QueueBlock *block = NULL;
+  QueueSlot *slot = NULL;
+  int block_num = queue->block_num;
+
+  for (int i = 0; i < block_num; i++) {
+    block = queue->map[queue->map_first +
+                       (queue->is_reversed ? block_num - 1 - i : i)];
+    for (int j = 0; j < BlockCount(block); j++) {
+      slot = &block->slots[queue->is_reversed ? block->end - 1 - j
+                                              : block->begin + j];
+      if (!StringSetAdd(set, slot->value, slot->len)) {
+        SlotFree(queue, slot);
+        slot->value = NULL;
+        queue->size--;
+      }
+    }
+  }
+  ChunkedCompact(queue);
+}
+
+/* Removes repeated elements of a sorted queue, which are next to the
+ * first one of them, together with their towers
+ * update[level] is the last kept tower on each level */
+static void SortedDedup(Queue *queue) {
+  SkipTower *update[SKIP_MAX_LEVEL] = {NULL};
+  SkipTower *tower = queue->skip_head[0];
+  SkipTower *own_tower = NULL;
+  ListElement *element = queue->head;
+  ListElement *next = NULL;
+  ListElement *kept = NULL;
+
+  while (element) {
+    next = element->next;
+    own_tower = NULL;
+    if (tower && tower->element == element) {
+      own_tower = tower;
+      tower = tower->links[0].next;
+    }
+    if (kept && strcmp(kept->value, element->value) == 0) {
+      SortedUnlink(queue, element, own_tower, update);
+    } else {
+      kept = element;
+      for (int level = 0; own_tower && level < own_tower->level; level++) {
+        update[level] = own_tower;
+      }
+    }
+    element = next;
+  }
+}
+
+bool QueueDedup(Queue *queue, int *removed_num) {
+  StringSet set;
+  int size = 0;
+
+  if (removed_num) {
+    *removed_num = 0;
+  }
+  if (queue == NULL) {
     return false;
   }
-  remove_element = queue->head;
-  queue->head = queue->head->next;
-  free(remove_element->value);
-  free(remove_element);
-  queue->size--;
-  if(queue->size == 0){
-    queue->tail = NULL;
+  size = queue->size;
+  if (queue->kind == QUEUE_SORTED) {
+    SortedDedup(queue);
+  } else if (size > 1) {
+    if (!StringSetInit(&set, size, queue->is_interned)) {
+      return false;
+    }
+    if (queue->kind == QUEUE_CHUNKED) {
+      ChunkedDedup(queue, &set);
+    } else {
+      ListDedup(queue, &set);
+    }
+    free(set.slots);
+  }
+  if (removed_num) {
+    *removed_num = size - queue->size;
   }
+  UpdatePeaks(queue);
+  return true;
+}
+
+/* Return the element at physical position pos of a list queue, walking
+ * from the nearer end */
+static ListElement *ListAt(Queue *queue, int pos) {
+  ListElement *element = NULL;
+
+  if (pos < queue->size / 2) {
+    for (element = queue->head; pos > 0; pos--) {
+      element = element->next;
+    }
+  } else {
+    for (element = queue->tail; pos < queue->size - 1; pos++) {
+      element = element->prev;
+    }
+  }
+  return element;
+}
+
+/* Return the physical position of the element at position idx from the
+ * logical head of queue, or -1 if idx is out of range */
+static int PhysicalPos(Queue *queue, int idx) {
+  if (idx < 0 || idx >= queue->size) {
+    return -1;
+  }
+  return queue->is_reversed ? queue->size - 1 - idx : idx;
+}
+
+const char *QueueGet(Queue *queue, int idx) {
+  SkipTower *update[SKIP_MAX_LEVEL];
+  int pos = 0;
+  int map_idx = 0;
+
+  if (queue == NULL || (pos = PhysicalPos(queue, idx)) < 0) {
+    return NULL;
+  }
+  if (queue->kind == QUEUE_CHUNKED) {
+    return ChunkedSlot(queue, pos, &map_idx)->value;
+  }
+  if (queue->kind == QUEUE_SORTED) {
+    return SortedAt(queue, pos, update)->value;
+  }
+  return ListAt(queue, pos)->value;
+}
+
+bool QueueSet(Queue *queue, int idx, const char *str) {
+  QueueSlot *slot = NULL;
+  char *value = NULL;
+  size_t len = 0;
+  int pos = 0;
+  int map_idx = 0;
+
+  if (queue == NULL || str == NULL || queue->kind == QUEUE_SORTED ||
+      (pos = PhysicalPos(queue, idx)) < 0) {
+    return false;
+  }
+  len = strlen(str);
+  if (queue->kind == QUEUE_LIST) {
+    if (!ElementSetValue(queue, ListAt(queue, pos), str, len)) {
+      return false;
+    }
+  } else {
+    slot = ChunkedSlot(queue, pos, &map_idx);
+    value = StringNew(queue, str, len);
+    if (value == NULL) {
+      return false;
+    }
+    SlotFree(queue, slot);
+    slot->value = value;
+    slot->len = len;
+    CountString(queue, len);
+  }
+  UpdatePeaks(queue);
+  return true;
+}
+
+bool QueueDelete(Queue *queue, int idx) {
+  int pos = 0;
+
+  if (queue == NULL || (pos = PhysicalPos(queue, idx)) < 0) {
+    return false;
+  }
+  if (queue->kind == QUEUE_CHUNKED) {
+    ChunkedDelete(queue, pos);
+  } else if (queue->kind == QUEUE_SORTED) {
+    SortedDelete(queue, pos);
+  } else {
+    ListUnlink(queue, ListAt(queue, pos));
+  }
+  UpdatePeaks(queue);
+  return true;
+}
+
+/* Reverses the physical order of elements of a list or chunked queue
+ * and flips its direction, so that its logical order stays the same */
+static void QueueFlip(Queue *queue) {
+  ListElement *element = queue->head;
+  ListElement *next = NULL;
+  QueueBlock *block = NULL;
+  QueueSlot slot;
+  int begin = 0;
+
+  queue->is_reversed = !queue->is_reversed;
+  if (queue->kind == QUEUE_LIST) {
+    for (; element; element = next) {
+      next = element->next;
+      element->next = element->prev;
+      element->prev = next;
+    }
+    element = queue->head;
+    queue->head = queue->tail;
+    queue->tail = element;
+    return;
+  }
+  for (int i = 0; i < queue->block_num / 2; i++) {
+    block = queue->map[queue->map_first + i];
+    queue->map[queue->map_first + i] =
+        queue->map[queue->map_first + queue->block_num - 1 - i];
+    queue->map[queue->map_first + queue->block_num - 1 - i] = block;
+  }
+  for (int i = 0; i < queue->block_num; i++) {
+    block = queue->map[queue->map_first + i];
+    for (int j = 0; j < BlockCount(block) / 2; j++) {
+      slot = block->slots[block->begin + j];
+      block->slots[block->begin + j] = block->slots[block->end - 1 - j];
+      block->slots[block->end - 1 - j] = slot;
+    }
+    /* Mirrors the used range, so the front block still fills from its
+     * end and the back block from its begin */
+    begin = block->begin;
+    memmove(&block->slots[QUEUE_BLOCK_SLOTS - block->end],
+            &block->slots[begin], BlockCount(block) * sizeof(QueueSlot));
+    block->begin = QUEUE_BLOCK_SLOTS - block->end;
+    block->end = QUEUE_BLOCK_SLOTS - begin;
+  }
+  TreeBuild(queue);
+}
+
+/* Moves blocks of a non-empty chunked queue src to the logical tail of
+ * dst, whose direction src has
+ * On success, return true */
+static bool ChunkedConcat(Queue *dst, Queue *src) {
+  if (!MapReserve(dst, dst->is_reversed, src->block_num)) {
+    return false;
+  }
+  if (dst->is_reversed) {
+    dst->map_first -= src->block_num;
+    memcpy(dst->map + dst->map_first, src->map + src->map_first,
+           src->block_num * sizeof(QueueBlock *));
+  } else {
+    memcpy(dst->map + dst->map_first + dst->block_num,
+           src->map + src->map_first, src->block_num * sizeof(QueueBlock *));
+  }
+  dst->block_num += src->block_num;
+  TreeBuild(dst);
+  free(src->map);
+  free(src->block_tree);
+  return true;
+}
+
+/* Merges elements and towers of a non-empty sorted queue src into dst in
+ * one pass, the ones of dst first among equal strings
+ * last[level] is the last tower of the merged skip list on each level
+ * and last_pos[level] its position, which its span is measured from */
+static void SortedMerge(Queue *dst, Queue *src) {
+  SkipTower *last[SKIP_MAX_LEVEL] = {NULL};
+  int last_pos[SKIP_MAX_LEVEL];
+  SkipTower *towers[2] = {dst->skip_head[0], src->skip_head[0]};
+  SkipTower *tower = NULL;
+  ListElement *elements[2] = {dst->head, src->head};
+  ListElement *element = NULL;
+  ListElement *prev = NULL;
+  int size = dst->size + src->size;
+  int from = 0;
+  int pos = 0;
+
+  memset(dst->skip_head, 0, sizeof(dst->skip_head));
+  dst->head = NULL;
+  while (elements[0] || elements[1]) {
+    from = elements[0] == NULL ||
+           (elements[1] && strcmp(elements[1]->value, elements[0]->value) < 0);
+    element = elements[from];
+    elements[from] = element->next;
+    element->prev = prev;
+    if (prev) {
+      prev->next = element;
+    } else {
+      dst->head = element;
+    }
+    prev = element;
+    tower = towers[from];
+    if (tower && tower->element == element) {
+      towers[from] = tower->links[0].next;
+      for (int level = 0; level < tower->level; level++) {
+        if (last[level]) {
+          last[level]->links[level].next = tower;
+          last[level]->links[level].span = pos - last_pos[level];
+        } else {
+          dst->skip_head[level] = tower;
+          dst->skip_span[level] = pos + 1;
+        }
+        last[level] = tower;
+        last_pos[level] = pos;
+      }
+    }
+    pos++;
+  }
+  prev->next = NULL;
+  dst->tail = prev;
+  for (int level = 0; level < SKIP_MAX_LEVEL; level++) {
+    if (last[level]) {
+      last[level]->links[level].next = NULL;
+      last[level]->links[level].span = size - last_pos[level];
+    }
+  }
+  if (src->skip_level > dst->skip_level) {
+    dst->skip_level = src->skip_level;
+  }
+}
+
+bool QueueConcat(Queue *dst, Queue *src) {
+  QueueMapping *mapping = NULL;
+
+  if (dst == NULL || src == NULL || dst == src || dst->kind != src->kind ||
+      dst->is_interned || src->is_interned) {
+    return false;
+  }
+  if (src->size > 0) {
+    if (src->kind != QUEUE_SORTED && src->is_reversed != dst->is_reversed) {
+      QueueFlip(src);
+    }
+    if (src->kind == QUEUE_CHUNKED) {
+      if (!ChunkedConcat(dst, src)) {
+        return false;
+      }
+    } else if (src->kind == QUEUE_SORTED) {
+      SortedMerge(dst, src);
+    } else if (dst->is_reversed) {
+      ListSpliceFront(dst, src->head, src->tail);
+    } else {
+      ListSpliceBack(dst, src->head, src->tail);
+    }
+  } else if (src->kind == QUEUE_CHUNKED) {
+    free(src->map);
+    free(src->block_tree);
+  }
+  dst->size += src->size;
+  ArenaMerge(&dst->arena, &src->arena);
+  if (src->mappings) {
+    mapping = src->mappings;
+    while (mapping->next) {
+      mapping = mapping->next;
+    }
+    mapping->next = dst->mappings;
+    dst->mappings = src->mappings;
+  }
+  dst->node_bytes += src->node_bytes;
+  dst->len_sum += src->len_sum;
+  if (src->max_len > dst->max_len) {
+    dst->max_len = src->max_len;
+  }
+  UpdatePeaks(dst);
+  /* src starts over as an empty queue of its kind */
+  memset(src->skip_head, 0, sizeof(src->skip_head));
+  src->head = src->tail = NULL;
+  src->size = 0;
+  src->is_reversed = false;
+  src->mappings = NULL;
+  src->map = NULL;
+  src->block_tree = NULL;
+  src->map_cap = src->map_first = src->block_num = 0;
+  src->skip_level = 0;
+  src->node_bytes = src->len_sum = src->max_len = 0;
   return true;
 }
 
 int QueueSize(Queue *queue) {
-  if (queue == NULL || queue->head == NULL) {
+  if (queue == NULL) {
     return 0;
   }
   return queue->size;
 }
 
+void QueueMemUsage(Queue *queue, size_t *reserved, size_t *used) {
+  if (reserved) {
+    *reserved = queue ? ArenaReserved(&queue->arena) : 0;
+  }
+  if (used) {
+    *used = queue ? ArenaUsed(&queue->arena) : 0;
+  }
+}
+
+void QueueGetStats(Queue *queue, QueueStats *stats) {
+  memset(stats, 0, sizeof(QueueStats));
+  if (queue == NULL) {
+    return;
+  }
+  CountBytes(queue, &stats->node_bytes, &stats->string_bytes,
+             &stats->overhead_bytes);
+  stats->node_peak = queue->node_peak;
+  stats->string_peak = queue->string_peak;
+  stats->overhead_peak = queue->overhead_peak;
+  for (QueueMapping *mapping = queue->mappings; mapping;
+       mapping = mapping->next) {
+    stats->mapped_bytes += mapping->size;
+  }
+  if (queue->size > 0) {
+    stats->avg_len = (double)queue->len_sum / queue->size;
+  }
+  stats->max_len = queue->max_len;
+}
+
+/* Only flips the direction, elements stay where they are */
 void QueueReverse(Queue *queue) {
-  ListElement *previous_element = NULL;
-  ListElement *current_element = NULL;
-  ListElement *next_element = NULL;
+  if (queue != NULL && queue->kind != QUEUE_SORTED) {
+    queue->is_reversed = !queue->is_reversed;
+  }
+}
 
-  if (queue != NULL && queue->head != NULL) {
-    previous_element = queue->head;
-    current_element = queue->head->next;
-    queue->head = queue->tail;
-    queue->tail = previous_element;
-    previous_element->next = NULL;
-    while (current_element) {
-      next_element = current_element->next;
-      current_element->next = previous_element;
-      previous_element = current_element;
-      current_element = next_element;
+/* Gathers strings of queue into an array of sort items
+ * For a chunked queue, slots are copied into *slots which items refer to
+ * On success, return the items which need to be freed by caller
+ * On error, return NULL */
+static SortItem *GatherItems(Queue *queue, QueueSlot **slots) {
+  SortItem *items = malloc(queue->size * sizeof(SortItem));
+  ListElement *element = NULL;
+  QueueBlock *block = NULL;
+  size_t idx = 0;
+
+  *slots = NULL;
+  if (items == NULL) {
+    return NULL;
+  }
+  if (queue->kind == QUEUE_LIST) {
+    for (element = queue->head; element; element = element->next, idx++) {
+      items[idx].prefix = SortPrefix(element->value);
+      items[idx].value = element->value;
+      items[idx].ref = element;
     }
+    return items;
   }
+  *slots = malloc(queue->size * sizeof(QueueSlot));
+  if (*slots == NULL) {
+    free(items);
+    return NULL;
+  }
+  for (int i = 0; i < queue->block_num; i++) {
+    block = queue->map[queue->map_first + i];
+    for (int j = block->begin; j < block->end; j++, idx++) {
+      (*slots)[idx] = block->slots[j];
+      items[idx].prefix = SortPrefix(block->slots[j].value);
+      items[idx].value = block->slots[j].value;
+      items[idx].ref = &(*slots)[idx];
+    }
+  }
+  return items;
 }
 
+/* Puts elements of queue in the order of sorted items
+ * The physical order becomes ascending, so the direction is reset */
+static void ScatterItems(Queue *queue, SortItem *items) {
+  ListElement *element = NULL;
+  QueueBlock *block = NULL;
+  size_t idx = 0;
 
-ListElement *Merge(ListElement *left, ListElement *right) {
-  ListElement *head = NULL;
-
-  for (ListElement **iter = &head; true; iter = &((*iter)->next)) {
-    if (!left) {
-      *iter = right;
-      break;
+  queue->is_reversed = false;
+  if (queue->kind == QUEUE_LIST) {
+    queue->head = items[0].ref;
+    queue->head->prev = NULL;
+    for (int i = 0; i < queue->size - 1; i++) {
+      element = items[i].ref;
+      element->next = items[i + 1].ref;
+      element->next->prev = element;
     }
-    if (!right) {
-      *iter = left;
-      break;
+    queue->tail = items[queue->size - 1].ref;
+    queue->tail->next = NULL;
+    return;
+  }
+  for (int i = 0; i < queue->block_num; i++) {
+    block = queue->map[queue->map_first + i];
+    for (int j = block->begin; j < block->end; j++, idx++) {
+      block->slots[j] = *(QueueSlot *)items[idx].ref;
     }
-    if (strcmp(left->value, right->value) < 0) {
-      *iter = left;
-      left = left->next;
+  }
+}
+
+void QueueSort(Queue *queue) {
+  QueueSortMode(queue, SORT_MERGE);
+}
+
+bool QueueSortMode(Queue *queue, SortMode mode) {
+  return QueueSortParallel(queue, mode, 1, NULL);
+}
+
+bool QueueSortParallel(Queue *queue, SortMode mode, int thread_num,
+                       SortStats *stats) {
+  QueueSlot *slots = NULL;
+  SortItem *items = NULL;
+  bool is_sorted = false;
+  double start = SortNow();
+
+  if (stats) {
+    memset(stats, 0, sizeof(SortStats));
+    stats->thread_num = 1;
+  }
+  /* A sorted queue is always in order */
+  if (queue == NULL || queue->size < 2 || queue->kind == QUEUE_SORTED) {
+    return true;
+  }
+  items = GatherItems(queue, &slots);
+  if (items == NULL) {
+    return false;
+  }
+  if (stats) {
+    stats->gather_time = SortNow() - start;
+  }
+  is_sorted = SortItemsParallel(items, queue->size, mode, thread_num, stats);
+  if (is_sorted) {
+    start = SortNow();
+    ScatterItems(queue, items);
+    if (stats) {
+      stats->scatter_time = SortNow() - start;
+    }
+  }
+  free(items);
+  free(slots);
+  return is_sorted;
+}
+
+void QueueIterInit(QueueIter *iter, Queue *queue) {
+  QueueBlock *block = NULL;
+
+  if (iter == NULL) {
+    return;
+  }
+  memset(iter, 0, sizeof(QueueIter));
+  iter->queue = queue;
+  if (queue == NULL) {
+    return;
+  }
+  iter->element = queue->is_reversed ? queue->tail : queue->head;
+  if (queue->block_num > 0) {
+    if (queue->is_reversed) {
+      iter->block_idx = queue->block_num - 1;
+      block = queue->map[queue->map_first + iter->block_idx];
+      iter->slot_idx = block->end - 1;
     } else {
-      *iter = right;
-      right = right->next;
+      iter->slot_idx = queue->map[queue->map_first]->begin;
     }
   }
-  return head;
 }
 
-ListElement *MergeSort(ListElement *start) {
-  ListElement *slow = start;
-  ListElement *mid = NULL;
+/* Steps iter of a chunked queue to the neighbouring block while its
+ * position is past the end of its block, over inner blocks left empty
+ * by deletions */
+static void IterSkipUsedBlocks(QueueIter *iter) {
+  Queue *queue = iter->queue;
+  QueueBlock *block = NULL;
 
-  if (!start || !start->next) {
-    return start;
+  if (iter->block_idx < 0 || iter->block_idx >= queue->block_num) {
+    return;
   }
-  for (ListElement *fast = start->next; fast && fast->next;
-       fast = fast->next->next) {
-    slow = slow->next;
+  block = queue->map[queue->map_first + iter->block_idx];
+  if (queue->is_reversed) {
+    while (iter->slot_idx < block->begin && --iter->block_idx >= 0) {
+      block = queue->map[queue->map_first + iter->block_idx];
+      iter->slot_idx = block->end - 1;
+    }
+  } else {
+    while (iter->slot_idx == block->end &&
+           ++iter->block_idx < queue->block_num) {
+      block = queue->map[queue->map_first + iter->block_idx];
+      iter->slot_idx = block->begin;
+    }
   }
-  mid = slow->next;
-  slow->next = NULL;
+}
 
-  return Merge(MergeSort(start), MergeSort(mid));
+const char *QueueIterNext(QueueIter *iter) {
+  const char *value = NULL;
+  QueueBlock *block = NULL;
+  Queue *queue = NULL;
+
+  if (iter == NULL || iter->queue == NULL) {
+    return NULL;
+  }
+  queue = iter->queue;
+  if (queue->kind != QUEUE_CHUNKED) {
+    if (iter->element == NULL) {
+      return NULL;
+    }
+    value = iter->element->value;
+    iter->element =
+        queue->is_reversed ? iter->element->prev : iter->element->next;
+    return value;
+  }
+  if (iter->block_idx < 0 || iter->block_idx >= queue->block_num) {
+    return NULL;
+  }
+  block = queue->map[queue->map_first + iter->block_idx];
+  value = block->slots[iter->slot_idx].value;
+  iter->slot_idx += queue->is_reversed ? -1 : 1;
+  IterSkipUsedBlocks(iter);
+  return value;
 }
 
-void QueueSort(Queue *queue) {
-  ListElement *tail = NULL;
+void QueueIterSeek(QueueIter *iter, int num) {
+  QueueBlock *block = NULL;
+  Queue *queue = NULL;
+  int left = 0;
 
-  if (queue != NULL && queue->head != NULL) {
-    queue->head = MergeSort(queue->head);
-    tail = queue->head;
-    while (tail->next) {
-      tail = tail->next;
+  if (iter == NULL || iter->queue == NULL) {
+    return;
+  }
+  queue = iter->queue;
+  if (queue->kind != QUEUE_CHUNKED) {
+    for (; num > 0 && iter->element; num--) {
+      iter->element =
+          queue->is_reversed ? iter->element->prev : iter->element->next;
+    }
+    return;
+  }
+  while (num > 0 && iter->block_idx >= 0 &&
+         iter->block_idx < queue->block_num) {
+    block = queue->map[queue->map_first + iter->block_idx];
+    left = queue->is_reversed ? iter->slot_idx - block->begin + 1
+                              : block->end - iter->slot_idx;
+    if (num < left) {
+      iter->slot_idx += queue->is_reversed ? -num : num;
+      return;
     }
-    queue->tail = tail;
+    num -= left;
+    iter->slot_idx += queue->is_reversed ? -left : left;
+    IterSkipUsedBlocks(iter);
   }
 }
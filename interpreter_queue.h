@@ -1,50 +1,295 @@
 #ifndef INTERPRETER_QUEUE_H_
 #define INTERPRETER_QUEUE_H_
 
+#include "interpreter_arena.h"
+#include "interpreter_intern.h"
+#include "interpreter_sort.h"
 #include <stdbool.h>
+#include <stdint.h>
 #include <sys/types.h>
 
+/* Strings shorter than LIST_ELEMENT_INLINE_SIZE are kept inside the
+ * element, which makes an element 40 bytes on 64-bit systems */
+#define LIST_ELEMENT_INLINE_SIZE 12
+
 typedef struct ListElement {
+  /* Points to inline_value if the string fits, otherwise to a copy
+   * spilled to the arena of the queue */
   char *value;
   struct ListElement *next;
+  struct ListElement *prev;
+  /* Length of value without the null terminator */
+  unsigned int len;
+  char inline_value[LIST_ELEMENT_INLINE_SIZE];
 } ListElement;
 
+/* Number of slots in a block of a chunked queue */
+#define QUEUE_BLOCK_SLOTS 64
+
+/* An element of a chunked queue; the string lives in the arena */
+typedef struct QueueSlot {
+  char *value;
+  /* Length of value without the null terminator */
+  unsigned int len;
+} QueueSlot;
+
+/* A block of a chunked queue holds its elements in slots[begin..end)
+ * Blocks between the first and the last one may be partly filled or
+ * even empty after elements in the middle were deleted */
+typedef struct QueueBlock {
+  int begin;
+  int end;
+  QueueSlot slots[QUEUE_BLOCK_SLOTS];
+} QueueBlock;
+
+/* Levels of the skip list of a sorted queue; one tower in SKIP_FANOUT
+ * reaches a level higher, so SKIP_FANOUT^SKIP_MAX_LEVEL elements are
+ * served in O(log n) */
+#define SKIP_MAX_LEVEL 16
+#define SKIP_FANOUT 4
+
+/* A level of a tower: the next tower on the level and the number of
+ * elements after the tower up to that one, or up to the end of the queue
+ * if there is none */
+typedef struct SkipLink {
+  struct SkipTower *next;
+  int span;
+} SkipLink;
+
+/* An index entry of a sorted queue standing on element, linked to the
+ * next tower on each of its levels */
+typedef struct SkipTower {
+  ListElement *element;
+  int level;
+  SkipLink links[];
+} SkipTower;
+
+/* Read-only memory mapped by mmap(), e.g., a loaded snapshot, which
+ * elements of a queue may refer to instead of holding copies */
+typedef struct QueueMapping {
+  void *addr;
+  size_t size;
+  struct QueueMapping *next;
+} QueueMapping;
+
+typedef enum QueueKind {
+  QUEUE_LIST = 0, /* Doubly linked list of ListElement */
+  QUEUE_CHUNKED,  /* Deque of blocks of QueueSlot */
+  QUEUE_SORTED    /* Ascending list of ListElement indexed by a skip list */
+} QueueKind;
+
 typedef struct Queue{
+  /* head and tail are the physical ends of a list queue */
   ListElement *head;
   ListElement *tail;
   int size;
+  QueueKind kind;
+  /* The logical head is the physical tail if it's true, which makes
+   * QueueReverse() O(1) */
+  bool is_reversed;
+  /* Equal strings share one copy in intern if it's true */
+  bool is_interned;
+  InternTable intern;
+  /* Mappings which elements may refer to; unmapped by QueueFree() */
+  QueueMapping *mappings;
+  /* Blocks of a chunked queue are map[map_first..map_first + block_num) */
+  QueueBlock **map;
+  int map_cap;
+  int map_first;
+  int block_num;
+  /* Fenwick tree of map_cap + 1 counts over elements of the blocks
+   * between the first and the last one, indexed by position in map
+   * The end blocks change on every insertion and removal at head or
+   * tail, so they are left out to keep those O(1) */
+  int *block_tree;
+  /* Towers of a sorted queue start at skip_head[0..skip_level), which
+   * are skip_span[level] elements after a place before head, so that a
+   * position is found in O(log n) */
+  SkipTower *skip_head[SKIP_MAX_LEVEL];
+  int skip_span[SKIP_MAX_LEVEL];
+  int skip_level;
+  /* State of the generator of tower levels */
+  uint64_t skip_seed;
+  /* Elements and their strings are carved out of arena */
+  Arena arena;
+  /* Bytes of elements, blocks and towers in arena; the rest of the
+   * bytes in use hold strings */
+  size_t node_bytes;
+  /* Sum of lengths of strings in queue */
+  size_t len_sum;
+  /* Length of the longest string ever inserted */
+  size_t max_len;
+  /* Highest bytes seen after any insertion or removal */
+  size_t node_peak;
+  size_t string_peak;
+  size_t overhead_peak;
 } Queue;
 
+/* Memory accounting of a queue, kept up to date by every operation */
+typedef struct QueueStats {
+  /* Elements, blocks, towers and the block map */
+  size_t node_bytes;
+  size_t node_peak;
+  /* Strings copied into the arena and the intern table, if any */
+  size_t string_bytes;
+  size_t string_peak;
+  /* Reserved from the system but not in use */
+  size_t overhead_bytes;
+  size_t overhead_peak;
+  /* Mappings, e.g., loaded snapshots, which strings are referred to in */
+  size_t mapped_bytes;
+  double avg_len;
+  size_t max_len;
+} QueueStats;
+
+/* Walks elements of a queue of any kind from head to tail */
+typedef struct QueueIter {
+  Queue *queue;
+  ListElement *element;
+  int block_idx;
+  int slot_idx;
+} QueueIter;
+
 /* Creates a queue
  * On success, return a pointer to a queue
  * On error, return NULL */
 Queue *QueueNew();
 
+/* Creates a queue of the given kind
+ * On success, return a pointer to a queue
+ * On error, return NULL */
+Queue *QueueNewKind(QueueKind kind);
+
+/* Makes queue keep a single reference-counted copy of each distinct
+ * string, shared by all elements equal to it
+ * Return false if queue is NULL or not empty */
+bool QueueEnableIntern(Queue *queue);
+
+/* Hands memory mapped by mmap() over to queue, so that strings inserted
+ * from it are referred to instead of copied; QueueFree() unmaps it
+ * Return false if queue or mapping is NULL or memory allocation failed */
+bool QueueAttachMapping(Queue *queue, void *mapping, size_t mapping_size);
+
 /* Deletes elements of queue
  * No effect if queue is NULL */
 void QueueFree(Queue *queue);
 
-/* Inserts a string s at head of queue
+/* Inserts a string s at head of queue, or in order if queue is sorted
  * Return false if queue is NULL or memory allocation failed */
 bool QueueInsertHead(Queue *queue, char *s);
 
-/* Inserts a string s at tail of queue
+/* Inserts a string s at tail of queue, or in order if queue is sorted
  * Return false if queue is NULL or memory allocation failed */
 bool QueueInsertTail(Queue *queue, char *s);
 
-/* Removes an element from queue
+/* Inserts num strings packed back to back in strs, each one
+ * null-terminated, at head of queue as if QueueInsertHead() was called
+ * for each of them in order; the last string ends up at head
+ * The elements are built first and spliced in at once, or linked in
+ * order if queue is sorted
+ * Return false if queue or strs is NULL, num is negative or memory
+ * allocation failed, in which case queue is unchanged */
+bool QueueInsertHeadBatch(Queue *queue, const char *strs, int num);
+
+/* Inserts num strings packed back to back in strs, each one
+ * null-terminated, at tail of queue in order
+ * The elements are built first and spliced in at once, or linked in
+ * order if queue is sorted
+ * Return false if queue or strs is NULL, num is negative or memory
+ * allocation failed, in which case queue is unchanged */
+bool QueueInsertTailBatch(Queue *queue, const char *strs, int num);
+
+/* Inserts num packed strings as QueueInsertTailBatch() does, where the
+ * i-th one starts at offsets[i] of strs and ends before offsets[i + 1],
+ * so that no string is measured; offsets[0] must be 0
+ * Return false if queue, strs or offsets is NULL, num is negative or
+ * memory allocation failed, in which case queue is unchanged */
+bool QueueInsertTailPacked(Queue *queue, const char *strs,
+                           const uint64_t *offsets, int num);
+
+/* Removes an element from queue, the smallest one if queue is sorted
  * Return false if queue is NULL or empty */
 bool QueueRemoveHead(Queue *queue);
 
+/* Return the string at position idx from head of queue, found in
+ * O(log n) if queue is chunked or sorted, otherwise walking from the
+ * nearer end, which is O(1) only at the ends
+ * Return NULL if queue is NULL or idx is out of range */
+const char *QueueGet(Queue *queue, int idx);
+
+/* Replaces the string at position idx from head of queue by a copy of
+ * str, found as in QueueGet()
+ * Return false if queue or str is NULL, queue is sorted, idx is out of
+ * range or memory allocation failed, in which case queue is unchanged */
+bool QueueSet(Queue *queue, int idx, const char *str);
+
+/* Removes the element at position idx from head of queue, found as in
+ * QueueGet()
+ * Return false if queue is NULL or idx is out of range */
+bool QueueDelete(Queue *queue, int idx);
+
+/* Removes elements equal to an earlier one from head, so the first
+ * occurrence of each string stays in order, in O(n) expected time
+ * Strings are hashed into a set which refers to them rather than copies
+ * them, or compared with their neighbours if queue is sorted
+ * Sets *removed_num to the number of removed elements if it's not NULL
+ * Return false if queue is NULL or memory allocation failed, in which
+ * case queue is unchanged */
+bool QueueDedup(Queue *queue, int *removed_num);
+
+/* Moves all elements of src to tail of dst, or merges them in order if
+ * both are sorted, leaving src empty
+ * Elements are spliced rather than copied: the arena and mappings of
+ * src which they live in are handed over to dst
+ * Return false if dst or src is NULL, they are the same queue, their
+ * kinds differ, either interns strings or memory allocation failed, in
+ * which case both are unchanged */
+bool QueueConcat(Queue *dst, Queue *src);
+
 /* Return number of elements in queue
  * Return 0 if queue is NULL or empty */
 int QueueSize(Queue *queue);
 
-/* Reverse queue 
- * No effect if queue is NULL or empty*/
+/* Gets bytes reserved from the system and bytes in use by queue
+ * Both are 0 if queue is NULL */
+void QueueMemUsage(Queue *queue, size_t *reserved, size_t *used);
+
+/* Fills stats of queue in O(1), without walking its elements
+ * max_len is the longest string ever inserted, which may have been
+ * removed since
+ * All are 0 if queue is NULL */
+void QueueGetStats(Queue *queue, QueueStats *stats);
+
+/* Reverse queue in O(1) by flipping its direction
+ * No effect if queue is NULL, empty or sorted */
 void QueueReverse(Queue *queue);
 
 /* Sort elements of queue in ascending order
- * No effect if queue is NULL or empty */
+ * No effect if queue is NULL, empty or sorted */
 void QueueSort(Queue *queue);
+
+/* Sort elements of queue in ascending order with the given engine
+ * All engines give the same order as strcmp()
+ * Return false if memory allocation failed, in which case queue is
+ * unchanged; no effect if queue is NULL, empty or sorted */
+bool QueueSortMode(Queue *queue, SortMode mode);
+
+/* Sort elements of queue in ascending order with the given engine on
+ * up to thread_num threads, serially if the queue is small
+ * Fills stats with the time of each phase if it's not NULL
+ * Return false if memory allocation or thread creation failed, in which
+ * case queue is unchanged; no effect if queue is NULL, empty or sorted */
+bool QueueSortParallel(Queue *queue, SortMode mode, int thread_num,
+                       SortStats *stats);
+
+/* Points iter at the head of queue */
+void QueueIterInit(QueueIter *iter, Queue *queue);
+
+/* Return the current string and advances iter
+ * Return NULL after the tail */
+const char *QueueIterNext(QueueIter *iter);
+
+/* Advances iter by num elements, skipping whole blocks of a chunked queue
+ * at a time; stops after the tail */
+void QueueIterSeek(QueueIter *iter, int num);
 #endif 
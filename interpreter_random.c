@@ -0,0 +1,65 @@
+#include "interpreter_random.h"
+
+/* Return x rotated left by k bits */
+static uint64_t RandomRotate(uint64_t x, int k) {
+  return (x << k) | (x >> (64 - k));
+}
+
+void RandomSeed(Random *random, uint64_t seed) {
+  uint64_t z = 0;
+
+  if (random == NULL) {
+    return;
+  }
+  /* SplitMix64 never gives the all-zero state xoshiro can't leave */
+  for (int i = 0; i < 4; i++) {
+    seed += 0x9E3779B97F4A7C15ULL;
+    z = seed;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    random->state[i] = z ^ (z >> 31);
+  }
+}
+
+uint64_t RandomNext(Random *random) {
+  uint64_t *s = random->state;
+  uint64_t result = RandomRotate(s[1] * 5, 7) * 9;
+  uint64_t t = s[1] << 17;
+
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = RandomRotate(s[3], 45);
+  return result;
+}
+
+size_t RandomStrings(Random *random, char *buf, int num, size_t min_len,
+                     size_t max_len) {
+  const char alphabets[] = "abcdefghijklmnopqrstuvwxyz";
+  uint64_t bits = 0;
+  size_t len = 0;
+  char *str = buf;
+
+  if (random == NULL || buf == NULL || min_len > max_len) {
+    return 0;
+  }
+  for (int i = 0; i < num; i++) {
+    /* One draw gives the length and three letters, and each further one
+     * four letters, 16 bits a piece scaled into range */
+    bits = RandomNext(random);
+    len = min_len + (((bits & 0xFFFF) * (max_len - min_len + 1)) >> 16);
+    for (size_t j = 0; j < len; j++) {
+      if (j % 4 == 3) {
+        bits = RandomNext(random);
+      } else {
+        bits >>= 16;
+      }
+      str[j] = alphabets[((bits & 0xFFFF) * 26) >> 16];
+    }
+    str[len] = '\0';
+    str += len + 1;
+  }
+  return str - buf;
+}
@@ -0,0 +1,25 @@
+#ifndef INTERPRETER_RANDOM_H_
+#define INTERPRETER_RANDOM_H_
+#include <stddef.h>
+#include <stdint.h>
+
+/* State of a xoshiro256** generator */
+typedef struct Random {
+  uint64_t state[4];
+} Random;
+
+/* Seeds random from seed expanded by SplitMix64, so that equal seeds
+ * give equal sequences
+ * No effect if random is NULL */
+void RandomSeed(Random *random, uint64_t seed);
+
+/* Return the next 64 random bits of random */
+uint64_t RandomNext(Random *random);
+
+/* Generates num strings of min_len to max_len lowercase letters into buf,
+ * packed back to back, each one null-terminated
+ * buf must hold at least num * (max_len + 1) characters
+ * Return the number of characters written */
+size_t RandomStrings(Random *random, char *buf, int num, size_t min_len,
+                     size_t max_len);
+#endif
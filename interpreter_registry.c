@@ -0,0 +1,197 @@
+#include "interpreter_registry.h"
+#include <stdlib.h>
+#include <string.h>
+
+void RegistryInit(QueueRegistry *registry) {
+  if (registry) {
+    memset(registry, 0, sizeof(QueueRegistry));
+  }
+}
+
+/* Return the index of the entry of name, or of the empty entry where it
+ * belongs if it's missing; registry must have an empty entry */
+static size_t RegistryFind(QueueRegistry *registry, const char *name,
+                           uint64_t hash) {
+  size_t idx = hash & (registry->cap - 1);
+  RegistryEntry *entry = NULL;
+
+  while ((entry = &registry->entries[idx])->name != NULL) {
+    if (entry->hash == hash && strcmp(entry->name, name) == 0) {
+      break;
+    }
+    idx = (idx + 1) & (registry->cap - 1);
+  }
+  return idx;
+}
+
+/* Doubles the entries and rehashes them by their stored hashes
+ * On success, return true */
+static bool RegistryGrow(QueueRegistry *registry) {
+  size_t new_cap = registry->cap ? registry->cap * 2 : REGISTRY_MIN_CAP;
+  RegistryEntry *new_entries = NULL;
+  size_t idx = 0;
+
+  new_entries = calloc(new_cap, sizeof(RegistryEntry));
+  if (new_entries == NULL) {
+    return false;
+  }
+  for (size_t i = 0; i < registry->cap; i++) {
+    if (registry->entries[i].name == NULL) {
+      continue;
+    }
+    idx = registry->entries[i].hash & (new_cap - 1);
+    while (new_entries[idx].name) {
+      idx = (idx + 1) & (new_cap - 1);
+    }
+    new_entries[idx] = registry->entries[i];
+  }
+  free(registry->entries);
+  registry->entries = new_entries;
+  registry->cap = new_cap;
+  return true;
+}
+
+Queue *RegistryGet(QueueRegistry *registry, const char *name) {
+  size_t idx = 0;
+
+  if (registry == NULL || name == NULL || registry->num == 0) {
+    return NULL;
+  }
+  idx = RegistryFind(registry, name, InternHash(name, strlen(name)));
+  return registry->entries[idx].queue;
+}
+
+bool RegistryPut(QueueRegistry *registry, const char *name, Queue *queue) {
+  RegistryEntry *entry = NULL;
+  uint64_t hash = 0;
+
+  if (registry == NULL || name == NULL || queue == NULL) {
+    return false;
+  }
+  /* Keeps the load factor at most 1/2 */
+  if ((registry->num + 1) * 2 > registry->cap && !RegistryGrow(registry)) {
+    return false;
+  }
+  hash = InternHash(name, strlen(name));
+  entry = &registry->entries[RegistryFind(registry, name, hash)];
+  if (entry->name) {
+    if (entry->queue != queue) {
+      QueueFree(entry->queue);
+    }
+    entry->queue = queue;
+    return true;
+  }
+  entry->name = strdup(name);
+  if (entry->name == NULL) {
+    return false;
+  }
+  entry->hash = hash;
+  entry->queue = queue;
+  registry->num++;
+  return true;
+}
+
+Queue *RegistryTake(QueueRegistry *registry, const char *name) {
+  RegistryEntry *entries = NULL;
+  Queue *queue = NULL;
+  size_t mask = 0;
+  size_t idx = 0;
+  size_t next = 0;
+  size_t home = 0;
+
+  if (registry == NULL || name == NULL || registry->num == 0) {
+    return NULL;
+  }
+  entries = registry->entries;
+  mask = registry->cap - 1;
+  idx = RegistryFind(registry, name, InternHash(name, strlen(name)));
+  if (entries[idx].name == NULL) {
+    return NULL;
+  }
+  queue = entries[idx].queue;
+  free(entries[idx].name);
+  /* Shifts later entries of the probe run back so that lookups never
+   * stop at the hole, as InternRelease() does */
+  next = idx;
+  while (true) {
+    next = (next + 1) & mask;
+    if (entries[next].name == NULL) {
+      break;
+    }
+    home = entries[next].hash & mask;
+    if (idx <= next ? (home <= idx || home > next)
+                    : (home <= idx && home > next)) {
+      entries[idx] = entries[next];
+      idx = next;
+    }
+  }
+  memset(&entries[idx], 0, sizeof(RegistryEntry));
+  registry->num--;
+  return queue;
+}
+
+bool RegistryUse(QueueRegistry *registry, const char *name) {
+  char *current = NULL;
+
+  if (registry == NULL || name == NULL) {
+    return false;
+  }
+  current = strdup(name);
+  if (current == NULL) {
+    return false;
+  }
+  free(registry->current);
+  registry->current = current;
+  return true;
+}
+
+const char *RegistryCurrentName(QueueRegistry *registry) {
+  if (registry == NULL) {
+    return NULL;
+  }
+  return registry->current ? registry->current : REGISTRY_DEFAULT_NAME;
+}
+
+Queue *RegistryCurrent(QueueRegistry *registry) {
+  return RegistryGet(registry, RegistryCurrentName(registry));
+}
+
+static int RegistryCompare(const void *a, const void *b) {
+  return strcmp(((const RegistryEntry *)a)->name,
+                ((const RegistryEntry *)b)->name);
+}
+
+RegistryEntry *RegistryList(QueueRegistry *registry) {
+  RegistryEntry *list = NULL;
+  size_t num = 0;
+
+  if (registry == NULL || registry->num == 0) {
+    return NULL;
+  }
+  list = malloc(registry->num * sizeof(RegistryEntry));
+  if (list == NULL) {
+    return NULL;
+  }
+  for (size_t i = 0; i < registry->cap; i++) {
+    if (registry->entries[i].name) {
+      list[num++] = registry->entries[i];
+    }
+  }
+  qsort(list, num, sizeof(RegistryEntry), RegistryCompare);
+  return list;
+}
+
+void RegistryFree(QueueRegistry *registry) {
+  if (registry == NULL) {
+    return;
+  }
+  for (size_t i = 0; i < registry->cap; i++) {
+    if (registry->entries[i].name) {
+      free(registry->entries[i].name);
+      QueueFree(registry->entries[i].queue);
+    }
+  }
+  free(registry->entries);
+  free(registry->current);
+  RegistryInit(registry);
+}
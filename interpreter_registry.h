@@ -0,0 +1,66 @@
+#ifndef INTERPRETER_REGISTRY_H_
+#define INTERPRETER_REGISTRY_H_
+#include "interpreter_queue.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define REGISTRY_MIN_CAP 16           /* Initial number of entries */
+#define REGISTRY_DEFAULT_NAME "default" /* Current name until one is used */
+
+/* A queue and the name it's registered under */
+typedef struct RegistryEntry {
+  uint64_t hash;
+  char *name; /* NULL if the entry is empty */
+  Queue *queue;
+} RegistryEntry;
+
+/* An open addressing hash table of named queues with linear probing
+ * One name is current; commands work on the queue registered under it,
+ * which may be missing, e.g., after it was freed */
+typedef struct QueueRegistry {
+  RegistryEntry *entries;
+  size_t cap; /* Number of entries, a power of 2 */
+  size_t num; /* Number of registered queues */
+  char *current;
+} QueueRegistry;
+
+/* Initializes an empty registry whose current name is
+ * REGISTRY_DEFAULT_NAME
+ * No effect if registry is NULL */
+void RegistryInit(QueueRegistry *registry);
+
+/* Return the queue registered under name
+ * Return NULL if registry or name is NULL or no queue is registered */
+Queue *RegistryGet(QueueRegistry *registry, const char *name);
+
+/* Registers queue under name, freeing the queue registered before
+ * On success, return true
+ * On error, return false and queue is not registered */
+bool RegistryPut(QueueRegistry *registry, const char *name, Queue *queue);
+
+/* Unregisters the queue registered under name without freeing it
+ * Return the queue, or NULL if no queue is registered */
+Queue *RegistryTake(QueueRegistry *registry, const char *name);
+
+/* Makes name current, whether a queue is registered under it or not
+ * Return false if registry or name is NULL or memory allocation failed */
+bool RegistryUse(QueueRegistry *registry, const char *name);
+
+/* Return the current name
+ * Return NULL if registry is NULL */
+const char *RegistryCurrentName(QueueRegistry *registry);
+
+/* Return the queue registered under the current name
+ * Return NULL if registry is NULL or no queue is registered */
+Queue *RegistryCurrent(QueueRegistry *registry);
+
+/* Return a copy of the registered entries sorted by name, registry->num
+ * of them, which the caller frees
+ * On error or if registry is empty, return NULL */
+RegistryEntry *RegistryList(QueueRegistry *registry);
+
+/* Frees all registered queues and leaves registry empty
+ * No effect if registry is NULL */
+void RegistryFree(QueueRegistry *registry);
+#endif
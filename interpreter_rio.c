@@ -1,5 +1,7 @@
 #include "interpreter_rio.h"
 #include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
@@ -23,6 +25,31 @@ ssize_t WriteNum(int fd, void *usr_buf, size_t usr_buf_len) {
   return usr_buf_len;
 }
 
+int SyncDir(const char *file_name) {
+  const char *slash = strrchr(file_name, '/');
+  char *dir_name = NULL;
+  int fd = -1;
+  int ret = -1;
+
+  if (slash == NULL) {
+    dir_name = strdup(".");
+  } else {
+    /* The directory of "/file" is "/" */
+    dir_name = strndup(file_name, slash == file_name ? 1 : slash - file_name);
+  }
+  if (dir_name == NULL) {
+    return -1;
+  }
+  fd = open(dir_name, O_RDONLY | O_DIRECTORY);
+  free(dir_name);
+  if (fd < 0) {
+    return -1;
+  }
+  ret = fsync(fd);
+  close(fd);
+  return ret;
+}
+
 
 /* rio_read - This is a wrapper for the Unix read() function that
    transfers min(n, rio_cnt) bytes from an internal buffer to a user
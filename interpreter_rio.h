@@ -20,6 +20,11 @@ typedef struct RIO{
  * On success, the number of bytes written is returned
  * On error, return -1 and errno is set to indicate the error */
 ssize_t WriteNum(int fd, void *usr_buf, size_t usr_buf_len);
+/* Syncs the directory holding file_name, so that a file created,
+ * renamed or unlinked there is not lost on a crash
+ * On success, return 0
+ * On error, return -1 and errno is set to indicate the error */
+int SyncDir(const char *file_name);
 /* Initializes RIO */
 void RioReadInit(RIO *rp, int fd);
 /* Reads usrbuf of maxlen from a file descriptor rp->rio_fd
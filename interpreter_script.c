@@ -0,0 +1,373 @@
+#include "interpreter_script.h"
+#include "interpreter_mem.h"
+#include "interpreter_msg.h"
+#include "interpreter_token.h"
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+bool ScriptOpen(Script *script, const char *file_name) {
+  struct stat file_stat;
+
+  if (script == NULL || file_name == NULL) {
+    return false;
+  }
+  memset(script, 0, sizeof(Script));
+  ArenaInit(&script->strs);
+  script->file_name = file_name;
+  if (strcmp(file_name, SCRIPT_STDIN) == 0) {
+    script->fd = STDIN_FILENO;
+  } else {
+    script->fd = open(file_name, O_RDONLY);
+  }
+  if (script->fd < 0 || fstat(script->fd, &file_stat) < 0) {
+    ShowMsg("open file %s failed\n", file_name);
+    ScriptClose(script);
+    return false;
+  }
+  if (S_ISREG(file_stat.st_mode)) {
+    /* Lines are compiled where they are mapped, front to back */
+    script->text_len = file_stat.st_size;
+    script->is_eof = true;
+    if (script->text_len > 0) {
+      script->text = mmap(NULL, script->text_len, PROT_READ, MAP_PRIVATE,
+                          script->fd, 0);
+      if (script->text == MAP_FAILED) {
+        script->text = NULL;
+        ShowMsg("map file %s failed\n", file_name);
+        ScriptClose(script);
+        return false;
+      }
+      madvise(script->text, script->text_len, MADV_SEQUENTIAL);
+    }
+  } else {
+    script->buf_cap = SCRIPT_BUF_SIZE;
+    script->text = malloc(script->buf_cap);
+    if (!IsMemAlloc(script->text)) {
+      script->buf_cap = 0;
+      ScriptClose(script);
+      return false;
+    }
+  }
+  return true;
+}
+
+/* Reads more of a script read through a buffer, keeping the part not
+ * compiled yet and growing the buffer if a line fills it
+ * On success, return true, setting is_eof at the end of file */
+static bool ScriptFill(Script *script) {
+  size_t new_cap = 0;
+  char *new_text = NULL;
+  ssize_t num_read = 0;
+
+  if (script->text_pos > 0) {
+    memmove(script->text, script->text + script->text_pos,
+            script->text_len - script->text_pos);
+    script->text_len -= script->text_pos;
+    script->text_pos = 0;
+  }
+  if (script->text_len == script->buf_cap) {
+    new_cap = script->buf_cap * 2;
+    new_text = realloc(script->text, new_cap);
+    if (!IsMemAlloc(new_text)) {
+      return false;
+    }
+    script->text = new_text;
+    script->buf_cap = new_cap;
+  }
+  do {
+    num_read = read(script->fd, script->text + script->text_len,
+                    script->buf_cap - script->text_len);
+  } while (num_read < 0 && errno == EINTR);
+  if (num_read < 0) {
+    ShowMsg("read file %s failed\n", script->file_name);
+    return false;
+  }
+  script->text_len += num_read;
+  script->is_eof = num_read == 0;
+  return true;
+}
+
+/* Gets the next line of script without its newline, which stays valid
+ * until the next call if script is read through a buffer
+ * Return false at the end of file or on error, setting is_failed */
+static bool ScriptNextLine(Script *script, const char **line, size_t *len) {
+  const char *start = NULL;
+  const char *end = NULL;
+
+  while (true) {
+    start = script->text + script->text_pos;
+    end = memchr(start, '\n', script->text_len - script->text_pos);
+    if (end == NULL && script->is_eof) {
+      end = script->text + script->text_len;
+      if (start == end) {
+        return false;
+      }
+    }
+    if (end) {
+      *line = start;
+      *len = end - start;
+      script->text_pos = end - script->text;
+      script->text_pos += script->text_pos < script->text_len;
+      return true;
+    }
+    if (!ScriptFill(script)) {
+      script->is_failed = true;
+      return false;
+    }
+  }
+}
+
+/* Appends an instruction of opcode for line of line_len bytes
+ * On success, return a pointer to it
+ * On error, return NULL */
+static ScriptInstr *ScriptAppend(Script *script, ScriptOpcode opcode,
+                                 const char *line, int line_len) {
+  size_t new_cap = 0;
+  ScriptInstr *new_instrs = NULL;
+  ScriptInstr *instr = NULL;
+
+  if (script->num == script->cap) {
+    new_cap = script->cap ? script->cap * 2 : 64;
+    new_instrs = realloc(script->instrs, new_cap * sizeof(ScriptInstr));
+    if (new_instrs == NULL) {
+      return NULL;
+    }
+    script->instrs = new_instrs;
+    script->cap = new_cap;
+  }
+  /* A buffer may be refilled before the batch runs, so its lines are
+   * kept */
+  if (script->buf_cap > 0 && opcode != SCRIPT_END) {
+    line = ArenaStrndup(&script->strs, line, line_len);
+    if (line == NULL) {
+      return NULL;
+    }
+  }
+  instr = &script->instrs[script->num++];
+  memset(instr, 0, sizeof(ScriptInstr));
+  instr->opcode = opcode;
+  instr->line = line;
+  instr->line_len = line_len;
+  return instr;
+}
+
+/* Copies line of line_len bytes to strs of script and splits it there by
+ * Tokenize(), appending the arguments to args of script
+ * Return the number of arguments
+ * On error, return a negative number, TOKEN_TOO_MANY or TOKEN_UNCLOSED
+ * from Tokenize() or INT_MIN if memory allocation failed */
+static int ScriptSplit(Script *script, const char *line, int line_len) {
+  size_t new_cap = 0;
+  char **new_args = NULL;
+  CmdNum *new_nums = NULL;
+  char *strs = NULL;
+
+  if (script->args_num + TOKEN_MAX_ARGS + 1 > script->args_cap) {
+    new_cap = script->args_cap ? script->args_cap * 2 : 256;
+    new_args = realloc(script->args, new_cap * sizeof(char *));
+    if (new_args == NULL) {
+      return INT_MIN;
+    }
+    script->args = new_args;
+    new_nums = realloc(script->nums, new_cap * sizeof(CmdNum));
+    if (new_nums == NULL) {
+      return INT_MIN;
+    }
+    script->nums = new_nums;
+    script->args_cap = new_cap;
+  }
+  strs = ArenaStrndup(&script->strs, line, line_len);
+  if (strs == NULL) {
+    return INT_MIN;
+  }
+  return Tokenize(strs, script->args + script->args_num, TOKEN_MAX_ARGS);
+}
+
+/* Parses argc arguments from args_num of script as decimal numbers into
+ * nums of script, so that commands repeated by a repeat block do not
+ * parse them on every iteration */
+static void ScriptParseNums(Script *script, int argc) {
+  char **args = script->args + script->args_num;
+  CmdNum *nums = script->nums + script->args_num;
+  char *end = NULL;
+  long value = 0;
+
+  for (int i = 0; i < argc; i++) {
+    nums[i].value = 0;
+    nums[i].is_num = false;
+    errno = 0;
+    value = strtol(args[i], &end, 10);
+    if (errno == 0 && end != args[i] && *end == '\0' && value >= INT_MIN &&
+        value <= INT_MAX) {
+      nums[i].value = value;
+      nums[i].is_num = true;
+    }
+  }
+}
+
+/* Return true if the arguments of a command are "repeat N {", setting
+ * *count to N */
+static bool ScriptIsRepeat(char **argv, int argc, long *count) {
+  char *end = NULL;
+
+  if (argc != 3 || strcmp(argv[0], "repeat") != 0 ||
+      strcmp(argv[2], "{") != 0) {
+    return false;
+  }
+  errno = 0;
+  *count = strtol(argv[1], &end, 10);
+  return errno == 0 && end != argv[1] && *end == '\0' && *count >= 0;
+}
+
+/* Compiles trimmed line of line_len bytes, a comment, a command or a
+ * line of a repeat block
+ * On success, return true */
+static bool ScriptCompileLine(Script *script, const char *line,
+                              int line_len) {
+  ScriptInstr *instr = NULL;
+  const CmdElement *cmd = NULL;
+  ScriptOpcode opcode = SCRIPT_CMD;
+  bool is_ambiguous = false;
+  long count = 0;
+  int argc = 0;
+
+  if (*line == '#') {
+    return IsMemAlloc(ScriptAppend(script, SCRIPT_COMMENT, line, line_len));
+  }
+  if (line_len == 1 && *line == '}') {
+    if (script->depth == 0) {
+      ShowMsg("%s:%d: } without repeat\n", script->file_name,
+              script->line_no);
+      return false;
+    }
+    instr = ScriptAppend(script, SCRIPT_END, "}", 1);
+    if (!IsMemAlloc(instr)) {
+      return false;
+    }
+    instr->jump = script->depth_idx[--script->depth];
+    script->instrs[instr->jump].jump = script->num - 1;
+    return true;
+  }
+
+  argc = ScriptSplit(script, line, line_len);
+  if (argc == INT_MIN) {
+    ShowMsg("memory allocation failed\n");
+    return false;
+  } else if (argc < 0) {
+    ShowMsg("%s:%d: %s\n", script->file_name, script->line_no,
+            TokenError(argc));
+    return false;
+  }
+  if (strcmp(script->args[script->args_num], "repeat") == 0) {
+    if (!ScriptIsRepeat(script->args + script->args_num, argc, &count)) {
+      ShowMsg("%s:%d: expected repeat N {, N>=0\n", script->file_name,
+              script->line_no);
+      return false;
+    }
+    if (script->depth == SCRIPT_MAX_DEPTH) {
+      ShowMsg("%s:%d: repeat blocks nest deeper than %d\n",
+              script->file_name, script->line_no, SCRIPT_MAX_DEPTH);
+      return false;
+    }
+    instr = ScriptAppend(script, SCRIPT_REPEAT, line, line_len);
+    if (!IsMemAlloc(instr)) {
+      return false;
+    }
+    instr->count = count;
+    script->depth_idx[script->depth] = script->num - 1;
+    script->depth_line[script->depth++] = script->line_no;
+    return true;
+  }
+
+  cmd = FindCmd(script->args[script->args_num], CMD_PREFIX_ALLOWED,
+                &is_ambiguous);
+  if (cmd) {
+    opcode = SCRIPT_CMD;
+  } else {
+    opcode = is_ambiguous ? SCRIPT_AMBIGUOUS : SCRIPT_UNKNOWN;
+  }
+  instr = ScriptAppend(script, opcode, line, line_len);
+  if (!IsMemAlloc(instr)) {
+    return false;
+  }
+  instr->cmd = cmd;
+  instr->argc = argc;
+  instr->arg_idx = script->args_num;
+  ScriptParseNums(script, argc);
+  script->args_num += argc + 1;
+  return true;
+}
+
+bool ScriptCompileNext(Script *script) {
+  const char *line = NULL;
+  const char *line_end = NULL;
+  size_t line_len = 0;
+  size_t ready_num = 0; /* Instructions outside open repeat blocks */
+
+  if (script == NULL) {
+    return false;
+  }
+  script->num = 0;
+  script->args_num = 0;
+  ArenaRelease(&script->strs);
+  if (script->is_failed) {
+    return false;
+  }
+  while (ScriptNextLine(script, &line, &line_len)) {
+    script->line_no++;
+    line_end = line + line_len;
+    while (line < line_end && isspace((unsigned char)*line)) {
+      line++;
+    }
+    while (line_end > line && isspace((unsigned char)*(line_end - 1))) {
+      line_end--;
+    }
+    if (line == line_end) {
+      continue;
+    }
+    if (!ScriptCompileLine(script, line, line_end - line)) {
+      script->is_failed = true;
+      break;
+    }
+    if (script->depth == 0) {
+      ready_num = script->num;
+      if (ready_num >= SCRIPT_BATCH_NUM) {
+        return true;
+      }
+    }
+  }
+  if (!script->is_failed && script->depth > 0) {
+    ShowMsg("%s:%d: repeat is not closed\n", script->file_name,
+            script->depth_line[script->depth - 1]);
+    script->is_failed = true;
+  }
+  /* A repeat block left open by an error never runs */
+  script->num = ready_num;
+  return script->num > 0;
+}
+
+void ScriptClose(Script *script) {
+  if (script == NULL) {
+    return;
+  }
+  if (script->buf_cap > 0) {
+    free(script->text);
+  } else if (script->text) {
+    munmap(script->text, script->text_len);
+  }
+  if (script->fd > STDIN_FILENO) {
+    close(script->fd);
+  }
+  free(script->instrs);
+  free(script->args);
+  free(script->nums);
+  ArenaRelease(&script->strs);
+  memset(script, 0, sizeof(Script));
+}
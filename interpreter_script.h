@@ -0,0 +1,80 @@
+#ifndef INTERPRETER_SCRIPT_H_
+#define INTERPRETER_SCRIPT_H_
+#include "interpreter_arena.h"
+#include "interpreter_console.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+#define SCRIPT_MAX_DEPTH 64 /* Nesting of repeat blocks */
+/* Instructions compiled before they run, unless a repeat block is longer */
+#define SCRIPT_BATCH_NUM 4096
+#define SCRIPT_BUF_SIZE (1024 * 1024) /* Bytes read at once from a pipe */
+#define SCRIPT_STDIN "-" /* File name of a script read from stdin */
+
+typedef enum ScriptOpcode {
+  SCRIPT_CMD,       /* Runs cmd with argc arguments from args */
+  SCRIPT_UNKNOWN,   /* A command no name or prefix matches */
+  SCRIPT_AMBIGUOUS, /* A prefix of several command names */
+  SCRIPT_COMMENT,   /* A line starting with '#', which is printed */
+  SCRIPT_REPEAT,    /* "repeat N {", jump is the index of its SCRIPT_END */
+  SCRIPT_END        /* "}", jump is the index of its SCRIPT_REPEAT */
+} ScriptOpcode;
+
+typedef struct ScriptInstr {
+  ScriptOpcode opcode;
+  int argc;
+  size_t arg_idx; /* Index of the first argument in args */
+  const CmdElement *cmd;
+  /* Trimmed line, echoed when it runs */
+  const char *line;
+  int line_len;
+  long count; /* Iterations of a repeat block */
+  long remaining; /* Iterations of a repeat block left while it runs */
+  size_t jump;
+} ScriptInstr;
+
+/* A script compiled a batch at a time into instructions, whose commands
+ * are looked up and whose lines are split into arguments, parsed as
+ * numbers where they are, ahead of running
+ * A regular file is mapped into memory and its lines are used where they
+ * are; other files, e.g., stdin, are read through a buffer */
+typedef struct Script {
+  ScriptInstr *instrs;
+  size_t num;
+  size_t cap;
+  char **args; /* argc null-terminated arguments of each command */
+  CmdNum *nums; /* args parsed as numbers, at the same indexes */
+  size_t args_num;
+  size_t args_cap;
+  Arena strs; /* Strings of args and lines of a batch not mapped */
+  const char *file_name;
+  int fd;
+  /* Text of a mapped file, or the buffer of one read, where text_pos to
+   * text_len is yet to be compiled */
+  char *text;
+  size_t text_pos;
+  size_t text_len;
+  size_t buf_cap; /* 0 if text is mapped */
+  bool is_eof;
+  int line_no;
+  /* Open repeat blocks, their instruction indexes and lines */
+  size_t depth_idx[SCRIPT_MAX_DEPTH];
+  int depth_line[SCRIPT_MAX_DEPTH];
+  int depth;
+  bool is_failed; /* A line failed to compile */
+} Script;
+
+/* Opens file_name, or stdin if it's SCRIPT_STDIN, to be compiled
+ * On success, return true */
+bool ScriptOpen(Script *script, const char *file_name);
+
+/* Drops the last batch and compiles the next one, which ends at a line
+ * outside repeat blocks, reporting the line of a malformed one
+ * Instructions compiled before such a line are kept and is_failed is set
+ * Return true if there are instructions to run */
+bool ScriptCompileNext(Script *script);
+
+/* Unmaps or frees the text of script and its instructions
+ * No effect if script is NULL */
+void ScriptClose(Script *script);
+#endif
@@ -0,0 +1,214 @@
+#include "interpreter_snapshot.h"
+#include "interpreter_rio.h"
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SNAPSHOT_BUF_SIZE (1024 * 1024) /* Bytes written at a time */
+
+/* Appends len bytes of data to buf and writes buf to fd when it's full
+ * On success, return true */
+static bool BufferedWrite(int fd, char *buf, size_t *buf_len,
+                          const void *data, size_t len) {
+  if (*buf_len + len > SNAPSHOT_BUF_SIZE) {
+    if (WriteNum(fd, buf, *buf_len) < 0) {
+      return false;
+    }
+    *buf_len = 0;
+  }
+  if (len > SNAPSHOT_BUF_SIZE) {
+    return WriteNum(fd, (void *)data, len) >= 0;
+  }
+  memcpy(buf + *buf_len, data, len);
+  *buf_len += len;
+  return true;
+}
+
+uint32_t SnapshotFlags(QueueKind kind, bool is_interned) {
+  return (kind == QUEUE_CHUNKED ? SNAPSHOT_CHUNKED : 0) |
+         (kind == QUEUE_SORTED ? SNAPSHOT_SORTED : 0) |
+         (is_interned ? SNAPSHOT_INTERNED : 0);
+}
+
+QueueKind SnapshotKind(uint32_t flags) {
+  if (flags & SNAPSHOT_CHUNKED) {
+    return QUEUE_CHUNKED;
+  }
+  return flags & SNAPSHOT_SORTED ? QUEUE_SORTED : QUEUE_LIST;
+}
+
+/* Writes the snapshot of queue to fd
+ * On success, return true */
+static bool SnapshotWrite(Queue *queue, int fd) {
+  SnapshotHeader header;
+  QueueIter iter;
+  const char *value = NULL;
+  char *buf = NULL;
+  size_t buf_len = 0;
+  uint64_t offset = 0;
+  bool is_written = false;
+
+  buf = malloc(SNAPSHOT_BUF_SIZE);
+  if (buf == NULL) {
+    return false;
+  }
+  /* First pass writes offsets, which gives the size of the strings */
+  if (lseek(fd, sizeof(SnapshotHeader), SEEK_SET) < 0) {
+    goto out;
+  }
+  QueueIterInit(&iter, queue);
+  while ((value = QueueIterNext(&iter)) != NULL) {
+    if (!BufferedWrite(fd, buf, &buf_len, &offset, sizeof(offset))) {
+      goto out;
+    }
+    offset += strlen(value) + 1;
+  }
+  if (!BufferedWrite(fd, buf, &buf_len, &offset, sizeof(offset))) {
+    goto out;
+  }
+  /* Second pass writes the strings */
+  QueueIterInit(&iter, queue);
+  while ((value = QueueIterNext(&iter)) != NULL) {
+    if (!BufferedWrite(fd, buf, &buf_len, value, strlen(value) + 1)) {
+      goto out;
+    }
+  }
+  if (WriteNum(fd, buf, buf_len) < 0) {
+    goto out;
+  }
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+  header.version = SNAPSHOT_VERSION;
+  header.flags = SnapshotFlags(queue->kind, queue->is_interned);
+  header.num = QueueSize(queue);
+  header.strings_size = offset;
+  if (lseek(fd, 0, SEEK_SET) < 0 ||
+      WriteNum(fd, &header, sizeof(header)) < 0) {
+    goto out;
+  }
+  is_written = true;
+out:
+  free(buf);
+  return is_written;
+}
+
+bool SnapshotSave(Queue *queue, const char *file_name) {
+  char *tmp_name = NULL;
+  size_t name_len = 0;
+  int fd = -1;
+  bool is_saved = false;
+
+  if (queue == NULL || file_name == NULL) {
+    return false;
+  }
+  name_len = strlen(file_name);
+  tmp_name = malloc(name_len + 5);
+  if (tmp_name == NULL) {
+    return false;
+  }
+  snprintf(tmp_name, name_len + 5, "%s.tmp", file_name);
+  fd = open(tmp_name, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  if (fd < 0) {
+    free(tmp_name);
+    return false;
+  }
+  is_saved = SnapshotWrite(queue, fd) && fsync(fd) == 0;
+  if (close(fd) != 0) {
+    is_saved = false;
+  }
+  if (is_saved && (rename(tmp_name, file_name) != 0 ||
+                   SyncDir(file_name) != 0)) {
+    is_saved = false;
+  }
+  if (!is_saved) {
+    unlink(tmp_name);
+  }
+  free(tmp_name);
+  return is_saved;
+}
+
+/* Checks that the mapping of size bytes is a well-formed snapshot
+ * Return true if it is */
+static bool SnapshotIsValid(const char *mapping, size_t size) {
+  const SnapshotHeader *header = (const SnapshotHeader *)mapping;
+  const uint64_t *offsets = NULL;
+  const char *strings = NULL;
+
+  if (size < sizeof(SnapshotHeader) ||
+      memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0 ||
+      header->version != SNAPSHOT_VERSION || header->num > INT_MAX ||
+      (size - sizeof(SnapshotHeader)) / sizeof(uint64_t) <= header->num) {
+    return false;
+  }
+  offsets = (const uint64_t *)(mapping + sizeof(SnapshotHeader));
+  strings = (const char *)(offsets + header->num + 1);
+  if (header->strings_size != size - (strings - mapping) ||
+      offsets[0] != 0 || offsets[header->num] != header->strings_size) {
+    return false;
+  }
+  /* Every string has to end with its own null terminator */
+  for (uint64_t i = 0; i < header->num; i++) {
+    if (offsets[i] >= offsets[i + 1] || strings[offsets[i + 1] - 1] != '\0') {
+      return false;
+    }
+  }
+  return true;
+}
+
+Queue *SnapshotLoad(const char *file_name) {
+  const SnapshotHeader *header = NULL;
+  const uint64_t *offsets = NULL;
+  const char *strings = NULL;
+  struct stat file_stat;
+  Queue *queue = NULL;
+  void *mapping = NULL;
+  size_t size = 0;
+  int fd = -1;
+
+  if (file_name == NULL || (fd = open(file_name, O_RDONLY)) < 0) {
+    return NULL;
+  }
+  if (fstat(fd, &file_stat) < 0 || file_stat.st_size == 0) {
+    close(fd);
+    return NULL;
+  }
+  size = file_stat.st_size;
+  mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    return NULL;
+  }
+  madvise(mapping, size, MADV_SEQUENTIAL);
+  if (!SnapshotIsValid(mapping, size)) {
+    munmap(mapping, size);
+    return NULL;
+  }
+  header = mapping;
+  offsets = (const uint64_t *)((const char *)mapping + sizeof(SnapshotHeader));
+  strings = (const char *)(offsets + header->num + 1);
+  queue = QueueNewKind(SnapshotKind(header->flags));
+  if (queue == NULL) {
+    munmap(mapping, size);
+    return NULL;
+  }
+  if (header->flags & SNAPSHOT_INTERNED) {
+    QueueEnableIntern(queue);
+  }
+  if (!QueueAttachMapping(queue, mapping, size)) {
+    munmap(mapping, size);
+    QueueFree(queue);
+    return NULL;
+  }
+  /* The offsets give the length of each string, which is not measured
+   * again */
+  if (!QueueInsertTailPacked(queue, strings, offsets, header->num)) {
+    QueueFree(queue);
+    return NULL;
+  }
+  return queue;
+}
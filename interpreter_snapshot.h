@@ -0,0 +1,46 @@
+#ifndef INTERPRETER_SNAPSHOT_H_
+#define INTERPRETER_SNAPSHOT_H_
+#include "interpreter_queue.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SNAPSHOT_MAGIC "IQSNAP01"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_CHUNKED 0x1  /* The queue was a chunked queue */
+#define SNAPSHOT_INTERNED 0x2 /* The queue interned strings */
+#define SNAPSHOT_SORTED 0x4   /* The queue was a sorted queue */
+
+/* A snapshot file is laid out as
+ *   SnapshotHeader
+ *   uint64_t offsets[num + 1]   start of each string in the string area,
+ *                               offsets[num] is strings_size
+ *   char strings[strings_size]  null-terminated strings back to back
+ * in the order from head to tail, in native byte order */
+typedef struct SnapshotHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t flags;
+  uint64_t num;
+  uint64_t strings_size;
+} SnapshotHeader;
+
+/* Return flags of a queue of kind, interning strings if is_interned */
+uint32_t SnapshotFlags(QueueKind kind, bool is_interned);
+
+/* Return the kind of a queue saved with flags */
+QueueKind SnapshotKind(uint32_t flags);
+
+/* Writes elements of queue from head to tail to file_name
+ * The file is written under a temporary name, synced and renamed, so
+ * file_name always holds a complete snapshot, and its directory is
+ * synced so that the rename survives a crash
+ * On success, return true */
+bool SnapshotSave(Queue *queue, const char *file_name);
+
+/* Maps file_name into memory and builds a queue of the saved kind whose
+ * elements refer to the strings of the mapping instead of copying them
+ * (strings are copied if the queue interns strings)
+ * On success, return a pointer to a queue
+ * On error, return NULL */
+Queue *SnapshotLoad(const char *file_name);
+#endif
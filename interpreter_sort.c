@@ -0,0 +1,345 @@
+#include "interpreter_sort.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Buckets smaller than this are sorted by insertion sort */
+#define RADIX_CUTOFF 32
+/* Runs of this many items are sorted by insertion sort before merging */
+#define MERGE_RUN 16
+#define RADIX_BUCKETS 256
+
+uint64_t SortPrefix(const char *str) {
+  uint64_t prefix = 0;
+  int i = 0;
+
+  for (; i < 8 && str[i]; i++) {
+    prefix = (prefix << 8) | (unsigned char)str[i];
+  }
+  return prefix << (8 * (8 - i));
+}
+
+int SortItemCompare(const SortItem *left, const SortItem *right) {
+  if (left->prefix != right->prefix) {
+    return left->prefix < right->prefix ? -1 : 1;
+  }
+  /* Same prefix with a zero byte means both strings end in it, and
+   * interned strings are equal if they are the same copy */
+  if ((left->prefix & 0xff) == 0 || left->value == right->value) {
+    return 0;
+  }
+  return strcmp(left->value + 8, right->value + 8);
+}
+
+/* Merges sorted left[0..left_num) and right[0..right_num) into out */
+static void MergeRuns(const SortItem *left, size_t left_num,
+                      const SortItem *right, size_t right_num,
+                      SortItem *out) {
+  const SortItem *left_end = left + left_num;
+  const SortItem *right_end = right + right_num;
+
+  while (left < left_end && right < right_end) {
+    /* Takes from left on ties to keep the sort stable */
+    if (SortItemCompare(right, left) < 0) {
+      *out++ = *right++;
+    } else {
+      *out++ = *left++;
+    }
+  }
+  if (left < left_end) {
+    memcpy(out, left, (left_end - left) * sizeof(SortItem));
+  }
+  if (right < right_end) {
+    memcpy(out, right, (right_end - right) * sizeof(SortItem));
+  }
+}
+
+bool SortItemsMerge(SortItem *items, size_t num) {
+  SortItem *buf = NULL;
+  SortItem *from = items;
+  SortItem *to = NULL;
+  SortItem *swap = NULL;
+  SortItem item;
+  size_t mid = 0;
+  size_t end = 0;
+  size_t j = 0;
+
+  if (items == NULL || num < 2) {
+    return true;
+  }
+  /* Sorts short runs in place first */
+  for (size_t start = 0; start < num; start += MERGE_RUN) {
+    end = start + MERGE_RUN < num ? start + MERGE_RUN : num;
+    for (size_t i = start + 1; i < end; i++) {
+      item = items[i];
+      for (j = i; j > start && SortItemCompare(&item, &items[j - 1]) < 0;
+           j--) {
+        items[j] = items[j - 1];
+      }
+      items[j] = item;
+    }
+  }
+  if (num <= MERGE_RUN) {
+    return true;
+  }
+  buf = malloc(num * sizeof(SortItem));
+  if (buf == NULL) {
+    return false;
+  }
+  /* Merges pairs of runs, doubling width, ping-ponging between buffers */
+  to = buf;
+  for (size_t width = MERGE_RUN; width < num; width *= 2) {
+    for (size_t start = 0; start < num; start += 2 * width) {
+      mid = start + width < num ? start + width : num;
+      end = start + 2 * width < num ? start + 2 * width : num;
+      MergeRuns(from + start, mid - start, from + mid, end - mid, to + start);
+    }
+    swap = from;
+    from = to;
+    to = swap;
+  }
+  if (from != items) {
+    memcpy(items, from, num * sizeof(SortItem));
+  }
+  free(buf);
+  return true;
+}
+
+/* Return the byte of item at depth, 0 after the end of its value */
+static unsigned char RadixByte(const SortItem *item, size_t depth) {
+  if (depth < 8) {
+    return (item->prefix >> (8 * (7 - depth))) & 0xff;
+  }
+  return (unsigned char)item->value[depth];
+}
+
+/* Sorts items whose first depth bytes are equal by insertion sort */
+static void InsertionSort(SortItem *items, size_t num, size_t depth) {
+  SortItem item;
+  size_t j = 0;
+
+  for (size_t i = 1; i < num; i++) {
+    item = items[i];
+    j = i;
+    while (j > 0 && (depth < 8 ? SortItemCompare(&item, &items[j - 1])
+                               : strcmp(item.value + depth,
+                                        items[j - 1].value + depth)) < 0) {
+      items[j] = items[j - 1];
+      j--;
+    }
+    items[j] = item;
+  }
+}
+
+/* Sorts items whose first depth bytes are equal by the byte at depth,
+ * permuting them in place (American flag sort), then sorts every
+ * bucket by the next byte */
+static void RadixSort(SortItem *items, size_t num, size_t depth) {
+  size_t count[RADIX_BUCKETS];
+  size_t next[RADIX_BUCKETS];
+  size_t end[RADIX_BUCKETS];
+  size_t start = 0;
+  SortItem item;
+  SortItem swap;
+  unsigned char byte = 0;
+
+  if (num < RADIX_CUTOFF) {
+    InsertionSort(items, num, depth);
+    return;
+  }
+  memset(count, 0, sizeof(count));
+  for (size_t i = 0; i < num; i++) {
+    count[RadixByte(&items[i], depth)]++;
+  }
+  for (int b = 0; b < RADIX_BUCKETS; b++) {
+    next[b] = start;
+    start += count[b];
+    end[b] = start;
+  }
+  /* Moves every item into its bucket by following cycles */
+  for (int b = 0; b < RADIX_BUCKETS; b++) {
+    while (next[b] < end[b]) {
+      item = items[next[b]];
+      byte = RadixByte(&item, depth);
+      while (byte != b) {
+        swap = items[next[byte]];
+        items[next[byte]++] = item;
+        item = swap;
+        byte = RadixByte(&item, depth);
+      }
+      items[next[b]++] = item;
+    }
+  }
+  /* Bucket 0 holds strings which end here, they are all equal */
+  start = count[0];
+  for (int b = 1; b < RADIX_BUCKETS; b++) {
+    if (count[b] > 1) {
+      RadixSort(items + start, count[b], depth + 1);
+    }
+    start += count[b];
+  }
+}
+
+void SortItemsRadix(SortItem *items, size_t num) {
+  if (items == NULL) {
+    return;
+  }
+  RadixSort(items, num, 0);
+}
+
+double SortNow() {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* A run of items sorted by one thread */
+typedef struct SortTask {
+  SortItem *items;
+  size_t num;
+  SortMode mode;
+  bool is_sorted;
+  pthread_t thread;
+} SortTask;
+
+static void *SortTaskRun(void *arg) {
+  SortTask *task = arg;
+
+  if (task->mode == SORT_RADIX) {
+    SortItemsRadix(task->items, task->num);
+    task->is_sorted = true;
+  } else {
+    task->is_sorted = SortItemsMerge(task->items, task->num);
+  }
+  return NULL;
+}
+
+/* Return true if head of run left goes before head of run right
+ * Ties go to the run with lower index to keep the merge stable */
+static bool RunLess(const SortTask *tasks, int left, int right) {
+  int cmp = SortItemCompare(tasks[left].items, tasks[right].items);
+
+  return cmp < 0 || (cmp == 0 && left < right);
+}
+
+/* Moves heap[idx] down until the heap of run heads is ordered again */
+static void HeapDown(const SortTask *tasks, int *heap, int heap_num,
+                     int idx) {
+  int child = 0;
+  int run = heap[idx];
+
+  while ((child = 2 * idx + 1) < heap_num) {
+    if (child + 1 < heap_num && RunLess(tasks, heap[child + 1], heap[child])) {
+      child++;
+    }
+    if (!RunLess(tasks, heap[child], run)) {
+      break;
+    }
+    heap[idx] = heap[child];
+    idx = child;
+  }
+  heap[idx] = run;
+}
+
+/* Merges the sorted runs of tasks into out by a binary heap of the
+ * heads of the runs; the runs are consumed */
+static void MergeTasks(SortTask *tasks, int task_num, SortItem *out) {
+  int heap[SORT_MAX_THREADS];
+  int heap_num = 0;
+  SortTask *task = NULL;
+
+  for (int i = 0; i < task_num; i++) {
+    if (tasks[i].num > 0) {
+      heap[heap_num++] = i;
+    }
+  }
+  for (int i = heap_num / 2 - 1; i >= 0; i--) {
+    HeapDown(tasks, heap, heap_num, i);
+  }
+  while (heap_num > 1) {
+    task = &tasks[heap[0]];
+    *out++ = *task->items++;
+    if (--task->num == 0) {
+      heap[0] = heap[--heap_num];
+    }
+    HeapDown(tasks, heap, heap_num, 0);
+  }
+  if (heap_num == 1) {
+    task = &tasks[heap[0]];
+    memcpy(out, task->items, task->num * sizeof(SortItem));
+  }
+}
+
+bool SortItemsParallel(SortItem *items, size_t num, SortMode mode,
+                       int thread_num, SortStats *stats) {
+  SortTask tasks[SORT_MAX_THREADS];
+  SortItem *buf = NULL;
+  size_t run_num = 0;
+  int started = 0;
+  bool is_sorted = true;
+  double start = SortNow();
+
+  if (items == NULL) {
+    return true;
+  }
+  if (thread_num > SORT_MAX_THREADS) {
+    thread_num = SORT_MAX_THREADS;
+  }
+  if (thread_num > (int)(num / SORT_PARALLEL_MIN_NUM)) {
+    thread_num = num / SORT_PARALLEL_MIN_NUM;
+  }
+  if (stats) {
+    stats->thread_num = thread_num > 1 ? thread_num : 1;
+    stats->merge_time = 0;
+  }
+  if (thread_num < 2) {
+    if (mode == SORT_RADIX) {
+      SortItemsRadix(items, num);
+    } else {
+      is_sorted = SortItemsMerge(items, num);
+    }
+    if (stats) {
+      stats->sort_time = SortNow() - start;
+    }
+    return is_sorted;
+  }
+  buf = malloc(num * sizeof(SortItem));
+  if (buf == NULL) {
+    return false;
+  }
+  /* Copies items so that they are unchanged if a thread fails */
+  memcpy(buf, items, num * sizeof(SortItem));
+  run_num = (num + thread_num - 1) / thread_num;
+  for (int i = 0; i < thread_num; i++) {
+    tasks[i].items = buf + i * run_num;
+    tasks[i].num = i * run_num >= num ? 0
+                   : (num - i * run_num < run_num ? num - i * run_num
+                                                  : run_num);
+    tasks[i].mode = mode;
+    tasks[i].is_sorted = false;
+    if (pthread_create(&tasks[i].thread, NULL, SortTaskRun, &tasks[i]) != 0) {
+      break;
+    }
+    started++;
+  }
+  for (int i = 0; i < started; i++) {
+    pthread_join(tasks[i].thread, NULL);
+    is_sorted = is_sorted && tasks[i].is_sorted;
+  }
+  if (started < thread_num || !is_sorted) {
+    free(buf);
+    return false;
+  }
+  if (stats) {
+    stats->sort_time = SortNow() - start;
+    start = SortNow();
+  }
+  MergeTasks(tasks, thread_num, items);
+  if (stats) {
+    stats->merge_time = SortNow() - start;
+  }
+  free(buf);
+  return true;
+}
@@ -0,0 +1,67 @@
+#ifndef INTERPRETER_SORT_H_
+#define INTERPRETER_SORT_H_
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* A string to be sorted along with its key prefix */
+typedef struct SortItem {
+  /* First 8 bytes of value in big-endian order, padded with zeros */
+  uint64_t prefix;
+  const char *value;
+  /* Element which value belongs to, for relinking after sorting */
+  void *ref;
+} SortItem;
+
+/* Below this many items per thread a parallel sort runs fewer threads */
+#define SORT_PARALLEL_MIN_NUM 65536
+#define SORT_MAX_THREADS 64
+
+/* Time spent in each phase of a sort, in seconds */
+typedef struct SortStats {
+  double gather_time;  /* Copying strings of a queue into items */
+  double sort_time;    /* Sorting runs, in parallel if thread_num > 1 */
+  double merge_time;   /* K-way merging the sorted runs */
+  double scatter_time; /* Relinking the queue in sorted order */
+  int thread_num;      /* Threads actually used */
+} SortStats;
+
+typedef enum SortMode {
+  SORT_MERGE = 0, /* Bottom-up merge sort */
+  SORT_RADIX      /* MSD radix sort */
+} SortMode;
+
+/* Return the first 8 bytes of str as a big-endian integer
+ * Bytes after the end of str are zeros */
+uint64_t SortPrefix(const char *str);
+
+/* Compares values of two items like strcmp() does, looking at the
+ * prefixes first
+ * Return a negative, zero or positive integer if left is less than,
+ * equal to or greater than right */
+int SortItemCompare(const SortItem *left, const SortItem *right);
+
+/* Sorts num items in ascending order of value by bottom-up merge sort
+ * Items are compared by their prefixes as integers and strcmp() is
+ * called only on ties
+ * Return false if memory allocation failed, in which case items are
+ * unchanged */
+bool SortItemsMerge(SortItem *items, size_t num);
+
+/* Sorts num items in ascending order of value by MSD radix sort
+ * The items are permuted in place, no effect if items is NULL */
+void SortItemsRadix(SortItem *items, size_t num);
+
+/* Splits items into thread_num runs, sorts them with the engine of
+ * mode on their own threads, then k-way merges the runs
+ * Falls back to a serial sort if there are fewer than
+ * SORT_PARALLEL_MIN_NUM items per thread
+ * Fills sort_time, merge_time and thread_num of stats if it's not NULL
+ * Return false if memory allocation or thread creation failed, in
+ * which case items are unchanged */
+bool SortItemsParallel(SortItem *items, size_t num, SortMode mode,
+                       int thread_num, SortStats *stats);
+
+/* Return seconds of a monotonic clock */
+double SortNow();
+#endif
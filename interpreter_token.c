@@ -0,0 +1,89 @@
+#include "interpreter_token.h"
+#include <ctype.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+char *TrimLine(char *str) {
+  char *end = NULL;
+
+  if (str == NULL) {
+    return NULL;
+  }
+  while (isspace((unsigned char)*str)) {
+    str++;
+  }
+  end = str + strlen(str);
+  while (end > str && isspace((unsigned char)*(end - 1))) {
+    end--;
+  }
+  *end = '\0';
+  return str;
+}
+
+int Tokenize(char *line, char **argv, int max_argc) {
+  char *read = line;
+  char *write = line;
+  char quote = '\0';
+  int argc = 0;
+
+  if (line == NULL || argv == NULL) {
+    return 0;
+  }
+  while (true) {
+    while (isspace((unsigned char)*read)) {
+      read++;
+    }
+    if (*read == '\0') {
+      break;
+    }
+    if (argc == max_argc) {
+      return TOKEN_TOO_MANY;
+    }
+    /* Writing never overtakes reading, since quotes and escapes are
+     * dropped and the rest is copied as it is */
+    argv[argc++] = write;
+    while (*read && (quote || !isspace((unsigned char)*read))) {
+      if (quote == '\'' && *read != '\'') {
+        *write++ = *read++;
+      } else if (quote && *read == quote) {
+        quote = '\0';
+        read++;
+      } else if (quote == '"' && *read == '\\' &&
+                 (read[1] == '"' || read[1] == '\\')) {
+        read++;
+        *write++ = *read++;
+      } else if (quote) {
+        *write++ = *read++;
+      } else if (*read == '\'' || *read == '"') {
+        quote = *read++;
+      } else if (*read == '\\' && read[1]) {
+        read++;
+        *write++ = *read++;
+      } else {
+        *write++ = *read++;
+      }
+    }
+    if (quote) {
+      return TOKEN_UNCLOSED;
+    }
+    /* Skips the separator before it may be overwritten by the end */
+    if (*read) {
+      read++;
+    }
+    *write++ = '\0';
+  }
+  argv[argc] = NULL;
+  return argc;
+}
+
+const char *TokenError(int error) {
+  switch (error) {
+  case TOKEN_TOO_MANY:
+    return "too many arguments";
+  case TOKEN_UNCLOSED:
+    return "quote is not closed";
+  default:
+    return "unknown error";
+  }
+}
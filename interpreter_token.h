@@ -0,0 +1,25 @@
+#ifndef INTERPRETER_TOKEN_H_
+#define INTERPRETER_TOKEN_H_
+
+#define TOKEN_MAX_ARGS 16 /* Arguments of a command, its name included */
+#define TOKEN_TOO_MANY -1 /* More than max_argc arguments */
+#define TOKEN_UNCLOSED -2 /* A quote is not closed */
+
+/* Trims leading and trailing whitespace of str in place
+ * Return a pointer to the first character left, or NULL if str is NULL */
+char *TrimLine(char *str);
+
+/* Splits line in place into arguments separated by whitespace, storing
+ * at most max_argc of them and a NULL after them in argv
+ * Characters between single quotes are taken as they are, and between
+ * double quotes only \" and \\ are escaped; outside quotes a backslash
+ * escapes any character, so "a b", 'a b' and a\ b are all one argument
+ * No memory is allocated, as arguments are never longer than the text
+ * they come from
+ * Return the number of arguments
+ * On error, return TOKEN_TOO_MANY or TOKEN_UNCLOSED */
+int Tokenize(char *line, char **argv, int max_argc);
+
+/* Return a message describing error returned by Tokenize() */
+const char *TokenError(int error);
+#endif
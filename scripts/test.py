@@ -31,9 +31,22 @@ def runTest(testCase, isVisible, isColored, useValgrind):
                  'testcase-07-q-ops.cmd',
                  'testcase-08-q-ops.cmd',
                  'testcase-09-q-ops.cmd',
-                 'testcase-10-q-ops.cmd']
+                 'testcase-10-q-ops.cmd',
+                 'testcase-11-q-ops.cmd',
+                 'testcase-12-q-ops.cmd',
+                 'testcase-13-q-ops.cmd',
+                 'testcase-14-q-ops.cmd',
+                 'testcase-15-q-ops.cmd',
+                 'testcase-16-q-ops.cmd',
+                 'testcase-17-q-ops.cmd',
+                 'testcase-18-q-ops.cmd',
+                 'testcase-19-q-ops.cmd',
+                 'testcase-20-q-ops.cmd',
+                 'testcase-21-q-ops.cmd',
+                 'testcase-22-q-ops.cmd',
+                 'testcase-23-q-ops.cmd']
     
-    scores = [10, 10, 10, 10, 10, 10, 10, 10, 10, 10]
+    scores = [10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10]
 
     if useValgrind:
         command = ['valgrind'] + command
@@ -0,0 +1,27 @@
+# Test of sort engines, serial and parallel, on list and chunked queues
+sort -radix
+new
+sort -radix
+ih steven
+it kenji
+it abcdefghijklmnop
+it abcdefghijklmnoa
+sort -radix
+it RAND 999999
+ih RAND 999999
+sort -radix
+sort -j 4
+size
+free
+new -chunked
+sort -radix
+ih steven
+it kenji
+sort
+it RAND 999999
+ih RAND 999999
+sort -radix
+reverse
+sort -radix -j 3
+size
+quit
@@ -0,0 +1,26 @@
+# Test of saving queues to snapshots and loading them back
+save /tmp/testcase-12.snap
+load /tmp/testcase-12-nonexistent.snap
+new
+ih steven
+it abcdefghijklmnopqrstuvwxyz
+it RAND 99999
+reverse
+save /tmp/testcase-12.snap
+free
+load /tmp/testcase-12.snap
+size
+ih kenji
+rh
+rh
+sort
+free
+new -chunked -intern
+it steven 3
+ih RAND 99999
+save /tmp/testcase-12.snap
+load /tmp/testcase-12.snap
+rh
+sort -radix
+size
+quit
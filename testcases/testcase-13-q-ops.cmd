@@ -0,0 +1,24 @@
+# Test of paging through list and chunked queues with show
+new
+show -summary
+ih steven
+show -summary
+it kenji
+it RAND 99999
+show -n 5
+show -from 50000 -n 5
+show -from 100005
+show -summary
+reverse
+show -from 99998
+show -summary
+free
+new -chunked
+it RAND 99999
+ih steven
+show -from 64 -n 3
+show -from 99995 -n 10
+reverse
+show -from 63 -n 3
+show -summary
+quit
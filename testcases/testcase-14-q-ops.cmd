@@ -0,0 +1,19 @@
+# Test of showing only changes of the queue in delta display mode
+display delta
+new
+ih steven
+it kenji 3
+ih RAND 5
+it RAND 70000
+rh
+reverse
+sort
+show -n 3
+free
+new -chunked
+rh
+it RAND 3
+display full
+it abc
+display
+quit
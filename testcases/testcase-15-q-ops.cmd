@@ -0,0 +1,22 @@
+# Test of sorted queues kept in order on insert
+new -sorted -chunked
+new -sorted
+rh
+ih steven
+it kenji
+ih abc 3
+it RAND 99999
+rh
+rh
+reverse
+sort
+sort -radix -j 2
+show -n 5
+show -summary
+free
+new -sorted -intern
+it RAND 50000
+it RAND 50000
+rh
+show -summary
+quit
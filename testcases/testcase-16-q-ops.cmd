@@ -0,0 +1,15 @@
+# Test of seeded random strings
+new
+it RAND 5 -seed 42
+ih RAND -seed 42 5
+it steven -seed 1
+it RAND 999999 -seed 7
+sort
+rh
+size
+free
+new -chunked
+ih RAND 999999 -seed 7
+it RAND 3
+size
+quit
@@ -0,0 +1,21 @@
+# Test of memory accounting
+display delta
+new
+stats
+it apple 3
+it a_string_longer_than_inline
+ih RAND 1000 -seed 3
+stats
+rh
+rh
+stats
+free
+new -chunked -intern
+it pear 200
+ih RAND 500 -seed 3
+stats
+free
+new -sorted
+it RAND 2000 -seed 9
+stats
+quit
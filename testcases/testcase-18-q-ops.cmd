@@ -0,0 +1,55 @@
+# Test of dedup
+new
+dedup
+it a
+it b
+it a
+it c
+it b
+ih c
+dedup
+reverse
+it a
+it d
+dedup
+free
+new -chunked
+it x 100
+ih y 70
+it x
+it z
+ih z
+dedup
+ih p 130
+reverse
+it q 3
+it p
+dedup
+free
+new -intern
+it k 3
+ih j 2
+it k
+dedup
+free
+new -sorted
+it m 5
+it a 70
+it n 2
+it a
+dedup
+it b
+it a 3
+it z
+rh
+dedup
+stats
+free
+display delta
+new
+it RAND 50000 -seed 5
+it RAND 50000 -seed 5
+size
+dedup
+size
+quit
@@ -0,0 +1,62 @@
+# Test of access by position
+new
+it a
+it b
+get 0
+set 1 bee
+del 0
+free
+new -chunked
+it x 200
+ih y 100
+set 150 mid
+get 150
+del 150
+get 150
+del 0
+del 298
+reverse
+set 0 last
+get 297
+del 100
+ih z
+rh
+dedup
+free
+new -chunked
+it a 64
+it b 64
+it c 64
+it d 64
+repeat 64 {
+del 64
+}
+show -from 64 -n 3
+show -from 63 -n 2
+show -summary
+reverse
+show -from 64 -n 3
+show -from 127 -n 2
+show -summary
+free
+new -sorted
+it m 3
+it a 70
+it z
+del 71
+del 0
+get 68
+set 1 b
+rh
+size
+display delta
+it RAND 3000 -seed 11
+get 1500
+del 1500
+get 1500
+ih zzz 5
+get 3074
+dedup
+get 0
+get 100
+quit
@@ -0,0 +1,53 @@
+# Test of named queues
+new a
+it x
+it y
+new b -chunked
+it p 3
+list
+use a
+ih w
+use c
+drop c
+new c -chunked
+ih q1
+ih q2
+reverse
+it r
+concat b c
+use b
+show
+size
+use c
+size
+new l2
+it u
+it v
+reverse
+concat a l2
+use a
+show
+concat a b
+concat b b
+new s1 -sorted
+it m
+it c
+new s2 -sorted
+it b
+it m
+it z
+concat s1 s2
+use s1
+show
+new i1 -intern
+concat a i1
+drop i1
+drop s2
+list
+use a
+free
+list
+drop s1
+new
+list
+quit
@@ -0,0 +1,36 @@
+# Test of repeat blocks
+new
+repeat 3 {
+  it a
+  repeat 2 {
+    ih b
+  }
+}
+repeat 0 {
+  it never
+}
+size
+display delta
+new -chunked
+repeat 1000 {
+  it RAND 10 -seed 7
+  rh
+}
+size
+display full
+new -sorted
+repeat 2 {
+  it z
+  # Inserted twice
+  it y
+}
+show
+# Numbers compiled once, also behind time, next to ones that are not
+repeat 2 {
+  get 1
+  time get 2
+  show -n 2 -from 1
+  get 1x
+  get 99999999999
+}
+quit
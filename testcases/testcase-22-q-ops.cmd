@@ -0,0 +1,14 @@
+# Test of quoted arguments
+new
+it "hello world"
+ih 'single  quoted'
+it escaped\ space
+it "say \"hi\"" 2
+it ""
+it 'it''s'
+set 0 "  padded  "
+get 0
+show
+dedup
+size
+quit
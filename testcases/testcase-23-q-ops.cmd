@@ -0,0 +1,12 @@
+# Test of time and latency
+new -chunked
+display delta
+time it RAND 1000 -seed 3
+time sort
+time reverse
+time time rh
+time show -summary
+time
+time zz
+latency
+quit